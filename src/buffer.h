@@ -1,15 +1,84 @@
 #ifndef BUFFER_H
 #define BUFFER_H
 
-const int QSIZ = 30;
+#include "tools.h"
+#include "instructions.h"
 
-template <typename T>
-class Queue {
+#include <cassert>
+
+//per-cycle traffic: one instruction issues, dispatches and commits,
+//the cdb carries one execute result and one load
+const int ISSUE_WIDTH = 1;
+const int COMMIT_WIDTH = 1;
+const int CDB_WIDTH = 2;
+
+//vector with inline storage for the per-cycle scratch lists, CAP is the caller's bound
+template <typename T, int CAP>
+class FixedVector {
+public:
+    T a[CAP];
+    int n;
+
+    FixedVector() {
+        n = 0;
+    }
+
+    //only the live elements are copied
+    FixedVector(const FixedVector &o) {
+        *this = o;
+    }
+
+    FixedVector & operator = (const FixedVector &o) {
+        n = o.n;
+        for (int i = 0; i < n; ++i) {
+            a[i] = o.a[i];
+        }
+        return *this;
+    }
+
+    void push_back(const T &x) {
+        assert(n < CAP);
+        a[n++] = x;
+    }
+
+    void clear() {
+        n = 0;
+    }
+
+    int size() const {
+        return n;
+    }
+
+    bool empty() const {
+        return n == 0;
+    }
+
+    T * begin() {
+        return a;
+    }
+
+    T * end() {
+        return a + n;
+    }
+
+    const T * begin() const {
+        return a;
+    }
+
+    const T * end() const {
+        return a + n;
+    }
+};
+
+//ring of SIZ slots (a power of two), one slot is kept empty to tell full from empty
+template <int SIZ>
+class Ring {
 public:
-    T que[QSIZ];
+    static_assert((SIZ & (SIZ - 1)) == 0, "ring size must be a power of two");
+    static const int MASK = SIZ - 1;
     int head, tail;
 
-    Queue() {
+    Ring() {
         head = tail = 0;
     }
 
@@ -18,24 +87,40 @@ public:
     }
 
     bool full() const {
-        return head == 0? (tail == QSIZ - 1) : (tail == head - 1);
+        return ((tail + 1) & MASK) == head;
     }
 
     void clear() {
         head = tail = 0;
     }
 
-    void push(T &x) {
-        que[tail] = x;
-        if (++tail == QSIZ) tail = 0;
+    int apply() const {
+        return tail;
     }
 
-    T front() const {
-        return que[head];
+    int size() const {
+        return (tail - head) & MASK;
     }
 
     void pop() {
-        if (++head == QSIZ) head = 0;
+        head = (head + 1) & MASK;
+    }
+};
+
+template <typename T, int SIZ>
+class Queue : public Ring<SIZ> {
+public:
+    using Ring<SIZ>::head;
+    using Ring<SIZ>::tail;
+    T que[SIZ];
+
+    void push(const T &x) {
+        que[tail] = x;
+        tail = (tail + 1) & Ring<SIZ>::MASK;
+    }
+
+    T front() const {
+        return que[head];
     }
 };
 
@@ -45,24 +130,54 @@ struct ROInfo {
     uint rd, val, pc, pred_pc;
     bool ready;
     int lsb_pos, rob_pos;
+    bool vp;        //a predicted value dependents may use before ready
+    uint vp_val;
     ROInfo() {}
     ROInfo(instruction_t _op, function_t _func, uint _rd, uint _pc, bool _ready, int _lsb_pos, int _rob_pos):
-        op(_op), func(_func), rd(_rd), pc(_pc), ready(_ready), lsb_pos(_lsb_pos), rob_pos(_rob_pos) {}
+        op(_op), func(_func), rd(_rd), pc(_pc), ready(_ready), lsb_pos(_lsb_pos), rob_pos(_rob_pos), vp(0) {}
 };
 
-class ReorderBuffer : public Queue<ROInfo> {
+//struct-of-arrays: operand lookups only touch ready/val
+template <int SIZ>
+class ReorderBuffer : public Ring<SIZ> {
 public:
-    ReorderBuffer() {
-        Queue();
+    using Ring<SIZ>::head;
+    using Ring<SIZ>::tail;
+    bool ready[SIZ];
+    uint val[SIZ];
+    instruction_t op[SIZ];
+    function_t func[SIZ];
+    uint rd[SIZ], pc[SIZ], pred_pc[SIZ];
+    int lsb_pos[SIZ];
+    bool vp[SIZ];
+    uint vp_val[SIZ];
+
+    void push(const ROInfo &x) {
+        ready[tail] = x.ready;
+        val[tail] = x.val;
+        op[tail] = x.op;
+        func[tail] = x.func;
+        rd[tail] = x.rd;
+        pc[tail] = x.pc;
+        pred_pc[tail] = x.pred_pc;
+        lsb_pos[tail] = x.lsb_pos;
+        vp[tail] = x.vp;
+        vp_val[tail] = x.vp_val;
+        tail = (tail + 1) & Ring<SIZ>::MASK;
     }
 
-    void update(int pos, uint val) {
-        que[pos].val = val;
-        que[pos].ready = 1;
-    } 
+    ROInfo front() const {
+        ROInfo ret(op[head], func[head], rd[head], pc[head], ready[head], lsb_pos[head], head);
+        ret.val = val[head];
+        ret.pred_pc = pred_pc[head];
+        ret.vp = vp[head];
+        ret.vp_val = vp_val[head];
+        return ret;
+    }
 
-    int apply() const {
-        return tail;
+    void update(int pos, uint x) {
+        val[pos] = x;
+        ready[pos] = 1;
     }
 };
 
@@ -78,29 +193,65 @@ struct LSInfo {
     }
 };
 
-class LoadStoreBuffer : public Queue<LSInfo> {
+//struct-of-arrays: broadcasts scan the tag arrays only
+template <int SIZ>
+class LoadStoreBuffer : public Ring<SIZ> {
 public:
+    using Ring<SIZ>::head;
+    using Ring<SIZ>::tail;
+    int qj[SIZ], qk[SIZ];
+    uint vj[SIZ], vk[SIZ];
+    instruction_t op[SIZ];
+    function_t func[SIZ];
+    uint A[SIZ], rd[SIZ];
+    bool ready[SIZ];
+
     LoadStoreBuffer() {
-        Queue();
+        for (int i = 0; i < SIZ; ++i) {
+            qj[i] = qk[i] = -1;
+        }
     }
 
-    void update(int id, uint x) {
-        for (int i = head; i != tail; ) {
-            if (que[i].qj == id) {
-                que[i].qj = -1;
-                que[i].vj = x;
-            }
-            if (que[i].qk == id) {
-                que[i].qk = -1;
-                que[i].vk = x;
-            }
-            if (++i == QSIZ) i = 0;
-        }
+    void push(const LSInfo &x) {
+        qj[tail] = x.qj;
+        qk[tail] = x.qk;
+        vj[tail] = x.vj;
+        vk[tail] = x.vk;
+        op[tail] = x.op;
+        func[tail] = x.func;
+        A[tail] = x.A;
+        rd[tail] = x.rd;
+        ready[tail] = x.ready;
+        tail = (tail + 1) & Ring<SIZ>::MASK;
     }
 
-    int apply() const {
-        return tail;
+    LSInfo front() const {
+        LSInfo ret;
+        ret.qj = qj[head];
+        ret.qk = qk[head];
+        ret.vj = vj[head];
+        ret.vk = vk[head];
+        ret.op = op[head];
+        ret.func = func[head];
+        ret.A = A[head];
+        ret.rd = rd[head];
+        ret.ready = ready[head];
+        return ret;
+    }
+
+    //dead slots are overwritten on push, so the whole array is scanned without branches
+    void update(int id, uint x) {
+        for (int i = 0; i < SIZ; ++i) {
+            bool hit = (qj[i] == id);
+            vj[i] = hit? x : vj[i];
+            qj[i] = hit? -1 : qj[i];
+        }
+        for (int i = 0; i < SIZ; ++i) {
+            bool hit = (qk[i] == id);
+            vk[i] = hit? x : vk[i];
+            qk[i] = hit? -1 : qk[i];
+        }
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,144 @@
+#ifndef CHECKER_H
+#define CHECKER_H
+
+#include "tools.h"
+#include "instructions.h"
+#include "memory.h"
+#include "syscall.h"
+#include "functional.h"
+
+#include <cstdio>
+#include <cstring>
+
+const int CHECK_BATCH = 256;    //retirements replayed at a time
+
+//lockstep co-simulation: the core's retirements are replayed on the in-order interpreter
+class CoSimChecker {
+
+private:
+    Functional_Simulator ref;
+    const Memory &core_mem;
+    Retire batch[CHECK_BATCH];
+    uint base[32];  //core registers right after batch[0]
+    int n;
+    LL checked;
+    bool failed;
+
+    //syscalls write guest memory the reference never sees, copy what the core's kernel wrote
+    void Mirror(uint ret) {
+        const uint *r = ref.regs();
+        uint buf = r[11], len = 0;
+        switch (r[17]) {
+        case SYS_READ:
+            len = ((int)ret > 0? ret : 0);
+            break;
+        case SYS_FSTAT:
+            len = (ret == 0? STAT_SIZE : 0);
+            break;
+        case SYS_CLOCK_GETTIME:
+            len = (ret == 0? 12 : 0);
+            break;
+        }
+        for (uint i = 0; i < len; ++i) {
+            ref.memory().Write(buf + i, 1, core_mem.Read(buf + i, 1));
+        }
+    }
+
+    static void DumpRegs(const char *name, const uint *r) {
+        fprintf(stderr, "%s registers:\n", name);
+        for (int i = 0; i < 32; ++i) {
+            fprintf(stderr, "  x%-2d %08x%s", i, r[i], (i & 3) == 3? "\n" : "");
+        }
+    }
+
+    //the core's registers at batch[k]: the snapshot taken at batch[0] with the later write-backs replayed
+    void Dump(int k, const Retire &want) {
+        const Retire &got = batch[k];
+        uint core_reg[32];
+        memcpy(core_reg, base, sizeof(core_reg));
+        for (int i = 1; i <= k; ++i) {
+            core_reg[batch[i].rd] = batch[i].val;
+        }
+        core_reg[0] = 0;
+        fprintf(stderr, "cosim: divergence at retirement %lld\n", checked);
+        fprintf(stderr, "  core: pc %08x op %d rd x%u val %08x", got.pc, got.op, got.rd, got.val);
+        if (got.addr || got.data) fprintf(stderr, " store %08x <- %08x", got.addr, got.data);
+        fprintf(stderr, "\n  ref:  pc %08x        rd x%u val %08x", want.pc, want.rd, want.val);
+        if (want.addr || want.data) fprintf(stderr, " store %08x <- %08x", want.addr, want.data);
+        fprintf(stderr, "\n");
+        DumpRegs("reference", ref.regs());
+        DumpRegs("core", core_reg);
+    }
+
+    //step the reference over r, want is what it retired
+    bool Check(const Retire &r, Retire &want) {
+        want = Retire(ref.pc(), 0, 0, r.op);
+        Instruction ins = Decode(ref.memory().Read(want.pc, 4));
+        if (want.pc != r.pc || (r.op == HALT) != (ins.TYPE == HALT) || (r.op == ECALL) != (ins.TYPE == ECALL)) {
+            return 0;
+        }
+        if (r.op == HALT) {
+            return 1;
+        }
+        if (r.op == ECALL) {
+            want.rd = r.rd;
+            want.val = r.val;
+            Mirror(r.val);
+            ref.skip(r.rd? r.val : ref.regs()[10]);
+        } else {
+            const uint *reg = ref.regs();
+            if (ins.FTYPE == STORE) {
+                want.addr = reg[ins.rs1] + ins.imm;
+                want.data = StoreData(ins.TYPE, reg[ins.rs2]);
+            }
+            want.rd = (ins.FTYPE != BRANCH && ins.FTYPE != STORE)? ins.rd : 0;
+            ref.step();
+            want.val = want.rd? reg[want.rd] : 0;
+        }
+        if (want.rd != r.rd || want.val != r.val || want.addr != r.addr || want.data != r.data) {
+            return 0;
+        }
+        ++checked;
+        return 1;
+    }
+
+public:
+    //image is the core's memory right after loading, it is copied once; entry is the core's first pc
+    CoSimChecker(const Memory &image, uint entry): ref(image, entry), core_mem(image), n(0), checked(0), failed(0) {}
+
+    //queue one retirement with the core's registers right after it, 0 once a divergence was found;
+    //ECALL and HALT are checked at once
+    inline bool push(const Retire &r, const uint *core_reg) {
+        if (n == 0) {
+            memcpy(base, core_reg, sizeof(base));
+        }
+        batch[n++] = r;
+        if (n == CHECK_BATCH || r.op == ECALL || r.op == HALT) {
+            return flush();
+        }
+        return 1;
+    }
+
+    //replay the queued retirements, stop at the first one the reference disagrees with
+    bool flush() {
+        Retire want;
+        for (int i = 0; i < n && !failed; ++i) {
+            if (!Check(batch[i], want)) {
+                failed = 1;
+                Dump(i, want);
+            }
+        }
+        n = 0;
+        return !failed;
+    }
+
+    bool diverged() const {
+        return failed;
+    }
+
+    LL retirements() const {
+        return checked;
+    }
+};
+
+#endif
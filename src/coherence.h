@@ -0,0 +1,173 @@
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include "tools.h"
+#include "memory.h"
+
+#include <mutex>
+
+const int LINE_BITS = 6;
+const int LINES = (MEM_SIZE >> LINE_BITS) + 1;
+const int MAX_CORES = 64;
+const int LOCK_STRIPES = 64;
+
+//MESI directory in front of the shared memory, every access is done under its line's lock
+class Directory {
+
+private:
+    enum state_t {
+        INVALID, SHARED, EXCLUSIVE, MODIFIED
+    };
+
+    struct Entry {
+        state_t state;
+        int owner;                      //holder of an E/M line
+        unsigned long long sharers;     //holders of an S line
+        Entry() {
+            state = INVALID;
+            owner = -1;
+            sharers = 0;
+        }
+    } dir[LINES];
+
+    std::mutex lock[LOCK_STRIPES];
+
+    std::mutex brk_lock;
+    uint brk;   //program break of the whole machine, 0 until the first brk call
+
+    //an access may straddle two lines, the stripes of both are held
+    void Lock(uint lo, uint hi) {
+        std::mutex &a = lock[lo & (LOCK_STRIPES - 1)], &b = lock[hi & (LOCK_STRIPES - 1)];
+        if (&a == &b) {
+            a.lock();
+        } else {
+            std::lock(a, b);
+        }
+    }
+
+    void Unlock(uint lo, uint hi) {
+        lock[lo & (LOCK_STRIPES - 1)].unlock();
+        if ((lo ^ hi) & (LOCK_STRIPES - 1)) {
+            lock[hi & (LOCK_STRIPES - 1)].unlock();
+        }
+    }
+
+    void ReadLine(Entry &e, int core) {
+        unsigned long long bit = 1ull << core;
+        if (e.state == INVALID) {
+            ++miss_cnt[core];
+            e.state = EXCLUSIVE;
+            e.owner = core;
+        } else if (e.state == SHARED) {
+            if (!(e.sharers & bit)) {
+                ++miss_cnt[core];
+                e.sharers |= bit;
+            }
+        } else if (e.owner != core) {
+            ++miss_cnt[core];
+            if (e.state == MODIFIED) ++writeback_cnt[core];
+            e.state = SHARED;
+            e.sharers = (1ull << e.owner) | bit;
+            e.owner = -1;
+        }
+    }
+
+    void WriteLine(Entry &e, int core) {
+        unsigned long long bit = 1ull << core;
+        if (e.state == SHARED) {
+            if (!(e.sharers & bit)) ++miss_cnt[core];
+            e.sharers &= ~bit;
+            for (; e.sharers; e.sharers &= e.sharers - 1) ++invalidate_cnt[core];
+        } else if (e.state != INVALID && e.owner != core) {
+            ++miss_cnt[core];
+            ++invalidate_cnt[core];
+            if (e.state == MODIFIED) ++writeback_cnt[core];
+        } else if (e.state == INVALID) {
+            ++miss_cnt[core];
+        }
+        e.state = MODIFIED;
+        e.owner = core;
+    }
+
+public:
+    //indexed by the requesting core, so each counter has a single writer thread
+    LL miss_cnt[MAX_CORES], invalidate_cnt[MAX_CORES], writeback_cnt[MAX_CORES];
+
+    Directory(): brk(0) {
+        memset(miss_cnt, 0, sizeof(miss_cnt));
+        memset(invalidate_cnt, 0, sizeof(invalidate_cnt));
+        memset(writeback_cnt, 0, sizeof(writeback_cnt));
+    }
+
+    //the harts run one program and share its heap: move the break to addr when it lies
+    //between the current break and limit, return the break; start is the heap's base
+    uint Brk(uint start, uint addr, uint limit) {
+        std::lock_guard<std::mutex> guard(brk_lock);
+        if (brk == 0) brk = start;
+        if (addr >= brk && addr <= limit) brk = addr;
+        return brk;
+    }
+
+    //accesses outside memory touch nothing and need no lock
+    uint Load(Memory &mem, int core, uint pc, int len) {
+        uint lo = pc >> LINE_BITS, hi = (pc + len - 1) >> LINE_BITS;
+        if (lo >= (uint)LINES || hi >= (uint)LINES) return mem.Read(pc, len);
+        Lock(lo, hi);
+        ReadLine(dir[lo], core);
+        if (hi != lo) ReadLine(dir[hi], core);
+        uint ret = mem.Read(pc, len);
+        Unlock(lo, hi);
+        return ret;
+    }
+
+    void Store(Memory &mem, int core, uint pc, int len, uint val) {
+        uint lo = pc >> LINE_BITS, hi = (pc + len - 1) >> LINE_BITS;
+        if (lo >= (uint)LINES || hi >= (uint)LINES) {
+            mem.Write(pc, len, val);
+            return;
+        }
+        Lock(lo, hi);
+        WriteLine(dir[lo], core);
+        if (hi != lo) WriteLine(dir[hi], core);
+        mem.Write(pc, len, val);
+        Unlock(lo, hi);
+    }
+
+    //read under the lines' locks without a coherence transaction, for refetching code
+    uint Peek(const Memory &mem, uint pc, int len) {
+        uint lo = pc >> LINE_BITS, hi = (pc + len - 1) >> LINE_BITS;
+        if (lo >= (uint)LINES || hi >= (uint)LINES) return mem.Read(pc, len);
+        Lock(lo, hi);
+        uint ret = mem.Read(pc, len);
+        Unlock(lo, hi);
+        return ret;
+    }
+};
+
+//a core's path to memory, through the directory when the memory is shared
+struct MemPort {
+    Memory *mem;
+    Directory *dir;     //null when the memory is private
+    int hart;
+
+    MemPort(Memory *_mem, Directory *_dir, int _hart): mem(_mem), dir(_dir), hart(_hart) {}
+
+    inline uint Read(uint pc, int len) {
+        return dir == nullptr? mem -> Read(pc, len) : dir -> Load(*mem, hart, pc, len);
+    }
+
+    inline void Write(uint pc, int len, uint val) {
+        if (dir == nullptr) {
+            mem -> Write(pc, len, val);
+        } else {
+            dir -> Store(*mem, hart, pc, len, val);
+        }
+    }
+
+    //instruction words, seen by the fetch side only
+    inline uint Fetch(uint pc) {
+        return dir == nullptr? mem -> Read(pc, 4) : dir -> Peek(*mem, pc, 4);
+    }
+};
+
+#endif
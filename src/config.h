@@ -0,0 +1,40 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "tools.h"
+#include "predictor.h"
+
+//machine shapes for Tomasulo_Simulator, ring sizes and the fetch width are powers of two
+struct DefaultConfig {
+    static const int INSQ_SIZE = 32;
+    static const int ROB_SIZE = 32;
+    static const int LSB_SIZE = 32;
+    static const int RS_SIZE = 30;
+    static const int FETCH_WORDS = 4;
+    typedef BranchPredictor<4096> Predictor;
+};
+
+struct SmallConfig {
+    static const int INSQ_SIZE = 8;
+    static const int ROB_SIZE = 8;
+    static const int LSB_SIZE = 8;
+    static const int RS_SIZE = 8;
+    static const int FETCH_WORDS = 2;
+    typedef BranchPredictor<256> Predictor;
+};
+
+struct WideConfig {
+    static const int INSQ_SIZE = 64;
+    static const int ROB_SIZE = 128;
+    static const int LSB_SIZE = 64;
+    static const int RS_SIZE = 64;
+    static const int FETCH_WORDS = 8;
+    typedef BranchPredictor<16384> Predictor;
+};
+
+//the default machine without dynamic branch prediction
+struct StaticConfig : DefaultConfig {
+    typedef StaticPredictor Predictor;
+};
+
+#endif
@@ -0,0 +1,4 @@
+#include "runner.h"
+
+template class Tomasulo_Simulator<DefaultConfig>;
+template int RunTomasulo<DefaultConfig>(const SimOptions &);
@@ -0,0 +1,4 @@
+#include "runner.h"
+
+template class Tomasulo_Simulator<SmallConfig>;
+template int RunTomasulo<SmallConfig>(const SimOptions &);
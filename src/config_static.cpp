@@ -0,0 +1,4 @@
+#include "runner.h"
+
+template class Tomasulo_Simulator<StaticConfig>;
+template int RunTomasulo<StaticConfig>(const SimOptions &);
@@ -0,0 +1,4 @@
+#include "runner.h"
+
+template class Tomasulo_Simulator<WideConfig>;
+template int RunTomasulo<WideConfig>(const SimOptions &);
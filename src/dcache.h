@@ -0,0 +1,148 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+#include "tools.h"
+#include "coherence.h"
+#include "prefetch.h"
+
+#include <iostream>
+
+const int DC_SETS = 64;
+const int DC_WAYS = 4;          //16KB of 64-byte lines
+const int MISS_LATENCY = 40;    //cycles to fill a line from memory
+const int PF_ISSUE = 1;         //prefetches sent per cycle
+
+//timing-only L1 data cache, values still come from Memory
+class DataCache {
+
+private:
+    struct Line {
+        uint tag;
+        LL ready;           //cycle the fill completes
+        LL lru;
+        bool valid;
+        bool prefetched;    //filled by the prefetcher and not touched yet
+        Line() {
+            valid = prefetched = 0;
+        }
+    } a[DC_SETS][DC_WAYS];
+
+    Prefetcher prefetcher;
+
+    //the load at the head of the load/store buffer waiting for its line
+    int wait_tag;
+    uint wait_addr;
+    LL wait_until;
+
+    Line * Find(uint line) {
+        Line *set = a[line & (DC_SETS - 1)];
+        for (int i = 0; i < DC_WAYS; ++i) {
+            if (set[i].valid && set[i].tag == line) {
+                return &set[i];
+            }
+        }
+        return nullptr;
+    }
+
+    Line * Fill(uint line, LL ready, bool pf) {
+        Line *set = a[line & (DC_SETS - 1)], *victim = &set[0];
+        for (int i = 0; i < DC_WAYS; ++i) {
+            if (!set[i].valid) {
+                victim = &set[i];
+                break;
+            }
+            if (set[i].lru < victim -> lru) victim = &set[i];
+        }
+        if (victim -> valid && victim -> prefetched) {
+            ++pf_unused;
+        }
+        victim -> valid = 1;
+        victim -> tag = line;
+        victim -> ready = ready;
+        victim -> lru = ready;
+        victim -> prefetched = pf;
+        return victim;
+    }
+
+    //cycle the data of addr is available
+    LL Access(uint pc, uint addr, LL clk) {
+        uint line = addr >> LINE_BITS;
+        ++load_cnt;
+        prefetcher.OnLoad(pc, addr);
+        Line *x = Find(line);
+        if (x == nullptr) {
+            ++miss_cnt;
+            prefetcher.OnMiss(line);
+            x = Fill(line, clk + MISS_LATENCY, 0);
+        } else if (x -> prefetched) {
+            x -> prefetched = 0;
+            ++pf_useful;
+            if (x -> ready > clk) ++pf_late;
+            prefetcher.OnMiss(line);
+        }
+        x -> lru = clk;
+        return x -> ready;
+    }
+
+public:
+    LL load_cnt, miss_cnt;
+    LL pf_issued, pf_useful, pf_late, pf_unused;
+
+    DataCache(prefetch_t mode): prefetcher(mode) {
+        wait_tag = -1;
+        load_cnt = miss_cnt = 0;
+        pf_issued = pf_useful = pf_late = pf_unused = 0;
+    }
+
+    //the load tagged tag at the head of the buffer, 1 once its data has arrived
+    bool Load(uint pc, uint addr, int tag, LL clk) {
+        if (wait_tag != tag || wait_addr != addr) {
+            wait_tag = tag;
+            wait_addr = addr;
+            wait_until = Access(pc, addr, clk);
+        }
+        if (wait_until > clk) return 0;
+        wait_tag = -1;
+        return 1;
+    }
+
+    //stores drain after commit and write around the cache: a hit refreshes the line,
+    //a miss allocates nothing, so data a program initialized still misses when it is read
+    void Store(uint addr, LL clk) {
+        Line *x = Find(addr >> LINE_BITS);
+        if (x == nullptr) return;
+        x -> prefetched = 0;    //not a load miss saved, no credit
+        x -> lru = clk;
+    }
+
+    //send queued prefetches for lines not already present or on their way
+    void Tick(LL clk) {
+        for (int i = 0; i < PF_ISSUE && !prefetcher.queue.empty(); ) {
+            uint line = prefetcher.queue.front();
+            prefetcher.queue.pop();
+            if (Find(line) != nullptr) continue;
+            Fill(line, clk + MISS_LATENCY, 1);
+            ++pf_issued;
+            ++i;
+        }
+    }
+
+    //a rollback dropped the waiting load
+    void Squash() {
+        wait_tag = -1;
+    }
+
+    void Report(std::ostream &os) const {
+        LL hits = load_cnt - miss_cnt;
+        os << "dcache loads: " << load_cnt << " hits: " << hits << " misses: " << miss_cnt << std::endl;
+        if (prefetcher.type() == PF_NONE) return;
+        //accuracy: used / sent, coverage: share of would-be misses removed, timeliness: used before arrival counts as late
+        os << "prefetches sent: " << pf_issued << " used: " << pf_useful << " late: " << pf_late
+           << " evicted unused: " << pf_unused << " dropped: " << prefetcher.drop_cnt << std::endl;
+        os << "accuracy: " << (pf_issued? 1.0 * pf_useful / pf_issued : 0)
+           << " coverage: " << (pf_useful + miss_cnt? 1.0 * pf_useful / (pf_useful + miss_cnt) : 0)
+           << " timeliness: " << (pf_useful? 1.0 * (pf_useful - pf_late) / pf_useful : 0) << std::endl;
+    }
+};
+
+#endif
@@ -0,0 +1,280 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include "tools.h"
+#include "instructions.h"
+#include "memory.h"
+
+//the AVX2 version is built whatever the compile flags and picked at run time
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DECODE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+const int DECODE_BATCH = 8;
+const int CODE_WORDS = MEM_SIZE >> 2;
+
+//raw fields of DECODE_BATCH words, every immediate format already sign extended
+struct DecodeFields {
+    uint word[DECODE_BATCH], opcode[DECODE_BATCH], func3[DECODE_BATCH], alt[DECODE_BATCH];
+    uint rd[DECODE_BATCH], rs1[DECODE_BATCH], rs2[DECODE_BATCH];
+    uint immI[DECODE_BATCH], immS[DECODE_BATCH], immB[DECODE_BATCH], immU[DECODE_BATCH], immJ[DECODE_BATCH];
+};
+
+//assemble DECODE_BATCH little-endian words from the one-byte-per-uint memory
+inline void GatherWords(const uint *bytes, uint *word) {
+#if defined(__SSE2__)
+    for (int k = 0; k < DECODE_BATCH; k += 4) {
+        const __m128i *p = (const __m128i *)(bytes + (k << 2));
+        __m128i lo = _mm_packs_epi32(_mm_loadu_si128(p), _mm_loadu_si128(p + 1));
+        __m128i hi = _mm_packs_epi32(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3));
+        _mm_storeu_si128((__m128i *)(word + k), _mm_packus_epi16(lo, hi));
+    }
+#else
+    for (int k = 0; k < DECODE_BATCH; ++k) {
+        const uint *p = bytes + (k << 2);
+        word[k] = p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+    }
+#endif
+}
+
+//reference for the vector versions
+inline void ExtractFieldsScalar(DecodeFields &f) {
+    for (int k = 0; k < DECODE_BATCH; ++k) {
+        uint w = f.word[k];
+        f.opcode[k] = w & 0x7F;
+        f.func3[k] = (w >> 12) & 7;
+        f.alt[k] = (w >> 30) & 1;
+        f.rd[k] = (w >> 7) & 31;
+        f.rs1[k] = (w >> 15) & 31;
+        f.rs2[k] = (w >> 20) & 31;
+        f.immI[k] = (int)w >> 20;
+        f.immS[k] = (f.immI[k] & ~31u) | f.rd[k];
+        f.immB[k] = ((int)w >> 19 & 0xFFFFF000) | (w >> 20 & 0x7E0) | (w >> 7 & 0x1E) | (w << 4 & 0x800);
+        f.immU[k] = w & 0xFFFFF000;
+        f.immJ[k] = ((int)w >> 11 & 0xFFF00000) | (w >> 20 & 0x7FE) | (w >> 9 & 0x800) | (w & 0xFF000);
+    }
+}
+
+#if defined(__SSE2__)
+
+inline void ExtractFieldsSse2(DecodeFields &f) {
+    const __m128i m5 = _mm_set1_epi32(31);
+    for (int k = 0; k < DECODE_BATCH; k += 4) {
+        __m128i w = _mm_loadu_si128((const __m128i *)(f.word + k));
+        __m128i rd = _mm_and_si128(_mm_srli_epi32(w, 7), m5);
+        _mm_storeu_si128((__m128i *)(f.opcode + k), _mm_and_si128(w, _mm_set1_epi32(0x7F)));
+        _mm_storeu_si128((__m128i *)(f.func3 + k), _mm_and_si128(_mm_srli_epi32(w, 12), _mm_set1_epi32(7)));
+        _mm_storeu_si128((__m128i *)(f.alt + k), _mm_and_si128(_mm_srli_epi32(w, 30), _mm_set1_epi32(1)));
+        _mm_storeu_si128((__m128i *)(f.rd + k), rd);
+        _mm_storeu_si128((__m128i *)(f.rs1 + k), _mm_and_si128(_mm_srli_epi32(w, 15), m5));
+        _mm_storeu_si128((__m128i *)(f.rs2 + k), _mm_and_si128(_mm_srli_epi32(w, 20), m5));
+        __m128i immI = _mm_srai_epi32(w, 20);
+        _mm_storeu_si128((__m128i *)(f.immI + k), immI);
+        _mm_storeu_si128((__m128i *)(f.immS + k), _mm_or_si128(_mm_andnot_si128(m5, immI), rd));
+        __m128i immB = _mm_and_si128(_mm_srai_epi32(w, 19), _mm_set1_epi32(0xFFFFF000));
+        immB = _mm_or_si128(immB, _mm_and_si128(_mm_srli_epi32(w, 20), _mm_set1_epi32(0x7E0)));
+        immB = _mm_or_si128(immB, _mm_and_si128(_mm_srli_epi32(w, 7), _mm_set1_epi32(0x1E)));
+        immB = _mm_or_si128(immB, _mm_and_si128(_mm_slli_epi32(w, 4), _mm_set1_epi32(0x800)));
+        _mm_storeu_si128((__m128i *)(f.immB + k), immB);
+        _mm_storeu_si128((__m128i *)(f.immU + k), _mm_and_si128(w, _mm_set1_epi32(0xFFFFF000)));
+        __m128i immJ = _mm_and_si128(_mm_srai_epi32(w, 11), _mm_set1_epi32(0xFFF00000));
+        immJ = _mm_or_si128(immJ, _mm_and_si128(_mm_srli_epi32(w, 20), _mm_set1_epi32(0x7FE)));
+        immJ = _mm_or_si128(immJ, _mm_and_si128(_mm_srli_epi32(w, 9), _mm_set1_epi32(0x800)));
+        immJ = _mm_or_si128(immJ, _mm_and_si128(w, _mm_set1_epi32(0xFF000)));
+        _mm_storeu_si128((__m128i *)(f.immJ + k), immJ);
+    }
+}
+
+#endif
+
+#ifdef DECODE_AVX2
+
+static_assert(DECODE_BATCH == 8, "the AVX2 version extracts one register of words");
+
+__attribute__((target("avx2"))) inline void ExtractFieldsAvx2(DecodeFields &f) {
+    const __m256i m5 = _mm256_set1_epi32(31);
+    __m256i w = _mm256_loadu_si256((const __m256i *)f.word);
+    __m256i rd = _mm256_and_si256(_mm256_srli_epi32(w, 7), m5);
+    _mm256_storeu_si256((__m256i *)f.opcode, _mm256_and_si256(w, _mm256_set1_epi32(0x7F)));
+    _mm256_storeu_si256((__m256i *)f.func3, _mm256_and_si256(_mm256_srli_epi32(w, 12), _mm256_set1_epi32(7)));
+    _mm256_storeu_si256((__m256i *)f.alt, _mm256_and_si256(_mm256_srli_epi32(w, 30), _mm256_set1_epi32(1)));
+    _mm256_storeu_si256((__m256i *)f.rd, rd);
+    _mm256_storeu_si256((__m256i *)f.rs1, _mm256_and_si256(_mm256_srli_epi32(w, 15), m5));
+    _mm256_storeu_si256((__m256i *)f.rs2, _mm256_and_si256(_mm256_srli_epi32(w, 20), m5));
+    __m256i immI = _mm256_srai_epi32(w, 20);
+    _mm256_storeu_si256((__m256i *)f.immI, immI);
+    _mm256_storeu_si256((__m256i *)f.immS, _mm256_or_si256(_mm256_andnot_si256(m5, immI), rd));
+    __m256i immB = _mm256_and_si256(_mm256_srai_epi32(w, 19), _mm256_set1_epi32(0xFFFFF000));
+    immB = _mm256_or_si256(immB, _mm256_and_si256(_mm256_srli_epi32(w, 20), _mm256_set1_epi32(0x7E0)));
+    immB = _mm256_or_si256(immB, _mm256_and_si256(_mm256_srli_epi32(w, 7), _mm256_set1_epi32(0x1E)));
+    immB = _mm256_or_si256(immB, _mm256_and_si256(_mm256_slli_epi32(w, 4), _mm256_set1_epi32(0x800)));
+    _mm256_storeu_si256((__m256i *)f.immB, immB);
+    _mm256_storeu_si256((__m256i *)f.immU, _mm256_and_si256(w, _mm256_set1_epi32(0xFFFFF000)));
+    __m256i immJ = _mm256_and_si256(_mm256_srai_epi32(w, 11), _mm256_set1_epi32(0xFFF00000));
+    immJ = _mm256_or_si256(immJ, _mm256_and_si256(_mm256_srli_epi32(w, 20), _mm256_set1_epi32(0x7FE)));
+    immJ = _mm256_or_si256(immJ, _mm256_and_si256(_mm256_srli_epi32(w, 9), _mm256_set1_epi32(0x800)));
+    immJ = _mm256_or_si256(immJ, _mm256_and_si256(w, _mm256_set1_epi32(0xFF000)));
+    _mm256_storeu_si256((__m256i *)f.immJ, immJ);
+}
+
+#endif
+
+typedef void (*FieldExtractor)(DecodeFields &f);
+
+//the widest version the host runs
+inline FieldExtractor PickExtractor() {
+#ifdef DECODE_AVX2
+    if (__builtin_cpu_supports("avx2")) return ExtractFieldsAvx2;
+#endif
+#if defined(__SSE2__)
+    return ExtractFieldsSse2;
+#else
+    return ExtractFieldsScalar;
+#endif
+}
+
+//predecoded image, struct-of-arrays indexed by pc >> 2
+class DecodeCache {
+
+private:
+    uchar type[CODE_WORDS], ftype[CODE_WORDS], rd[CODE_WORDS], rs1[CODE_WORDS], rs2[CODE_WORDS];
+    uint imm[CODE_WORDS];
+
+    void Store(int id, const Instruction &x) {
+        type[id] = x.TYPE;
+        ftype[id] = x.FTYPE;
+        rd[id] = x.rd;
+        rs1[id] = x.rs1;
+        rs2[id] = x.rs2;
+        imm[id] = x.imm;
+    }
+
+    //same classification as Decode, on the fields of a whole batch; fields a format
+    //does not use are cleared the way Decode leaves them
+    void Classify(int base, const DecodeFields &f) {
+        for (int k = 0; k < DECODE_BATCH; ++k) {
+            int id = base + k;
+            uint r = f.rd[k], s1 = f.rs1[k], s2 = f.rs2[k], im = 0;
+            instruction_t t;
+            function_t ft = IMM;
+            switch (f.opcode[k]) {
+            case 0x37:
+                t = LUI;
+                im = f.immU[k];
+                s1 = s2 = 0;
+                break;
+            case 0x17:
+                t = AUIPC;
+                im = f.immU[k];
+                s1 = s2 = 0;
+                break;
+            case 0x6F:
+                t = JAL;
+                ft = JUMP;
+                im = f.immJ[k];
+                s1 = s2 = 0;
+                break;
+            case 0x67:
+                t = JALR;
+                ft = JUMP;
+                im = f.immI[k];
+                s2 = 0;
+                break;
+            case 0x63:
+                t = Btype[f.func3[k]];
+                ft = BRANCH;
+                im = f.immB[k];
+                r = 0;
+                break;
+            case 0x03:
+                t = Itype1[f.func3[k]];
+                ft = LOAD;
+                im = f.immI[k];
+                s2 = 0;
+                break;
+            case 0x23:
+                t = Stype[f.func3[k]];
+                ft = STORE;
+                im = f.immS[k];
+                r = 0;
+                break;
+            case 0x13:
+                t = (f.func3[k] == 5 && f.alt[k])? SRAI : Itype2[f.func3[k]];
+                ft = CALCI;
+                im = f.immI[k];
+                s2 = 0;
+                break;
+            case 0x33:
+                t = Rtype[f.func3[k]];
+                if (f.alt[k]) {
+                    if (f.func3[k] == 0) t = SUB;
+                    if (f.func3[k] == 5) t = SRA;
+                }
+                ft = CALC;
+                break;
+            case 0x73:
+                if (f.word[k] == 0x00000073) {
+                    t = ECALL;
+                    ft = SYS;
+                } else {
+                    t = WOW;
+                }
+                r = s1 = s2 = 0;
+                break;
+            default:
+                t = WOW;
+                r = s1 = s2 = 0;
+                break;
+            }
+            if (f.word[k] == 0x0ff00513) {
+                t = HALT;
+                ft = RET;
+                r = s1 = s2 = im = 0;
+            }
+            type[id] = t;
+            ftype[id] = ft;
+            rd[id] = r;
+            rs1[id] = s1;
+            rs2[id] = s2;
+            imm[id] = im;
+        }
+    }
+
+public:
+    void Load(Memory &mem) {
+        DecodeFields f;
+        FieldExtractor extract = PickExtractor();
+        int id = 0;
+        for (; id + DECODE_BATCH <= CODE_WORDS; id += DECODE_BATCH) {
+            GatherWords(&mem[id << 2], f.word);
+            extract(f);
+            Classify(id, f);
+        }
+        for (; id < CODE_WORDS; ++id) {
+            Refresh(id << 2, mem.Read(id << 2, 4));
+        }
+    }
+
+    //re-decode the word at pc after memory changed under it, word is its new value
+    void Refresh(uint pc, uint word) {
+        if ((pc >> 2) >= (uint)CODE_WORDS) return;
+        Store(pc >> 2, Decode(word));
+    }
+
+    Instruction Get(uint pc) const {
+        uint id = pc >> 2;
+        if (id >= (uint)CODE_WORDS) {
+            Instruction ret;
+            ret.TYPE = WOW;
+            return ret;
+        }
+        Instruction ret((instruction_t)type[id], rd[id], rs1[id], rs2[id], imm[id]);
+        ret.FTYPE = (function_t)ftype[id];
+        return ret;
+    }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef FETCH_H
+#define FETCH_H
+
+#include "tools.h"
+#include "instructions.h"
+#include "memory.h"
+#include "decoder.h"
+#include "coherence.h"
+
+//fetch blocks of WORDS instructions, a power of two
+template <int WORDS>
+class FetchUnit {
+
+public:
+    static_assert((WORDS & (WORDS - 1)) == 0, "fetch width must be a power of two");
+    static const int BYTES = WORDS << 2;
+
+private:
+    struct Line {
+        uint addr;
+        bool valid;
+        Instruction ins[WORDS];
+        Line() {
+            valid = 0;
+        }
+    } line[2];
+    int now;    //line[now] is the current block, line[now ^ 1] the prefetched next line
+    DecodeCache image;
+
+    void Fill(Line &x, uint addr) {
+        x.addr = addr;
+        x.valid = 1;
+        for (int i = 0; i < WORDS; ++i) {
+            x.ins[i] = image.Get(addr + (i << 2));
+        }
+    }
+
+public:
+    int fill_cnt, prefetch_hit;
+
+    FetchUnit() {
+        now = 0;
+        fill_cnt = prefetch_hit = 0;
+    }
+
+    //batch decode the loaded image, fetch blocks are filled from it
+    void Load(Memory &mem) {
+        image.Load(mem);
+        line[0].valid = line[1].valid = 0;
+    }
+
+    //predecoded fetch block containing pc, index it with Offset(pc)
+    const Instruction * Block(uint pc) {
+        uint addr = pc & ~(BYTES - 1);
+        if (!line[now].valid || line[now].addr != addr) {
+            if (line[now ^ 1].valid && line[now ^ 1].addr == addr) {
+                now ^= 1;
+                ++prefetch_hit;
+            } else {
+                Fill(line[now], addr);
+                ++fill_cnt;
+            }
+            Fill(line[now ^ 1], addr + BYTES);
+        }
+        return line[now].ins;
+    }
+
+    static int Offset(uint pc) {
+        return (pc & (BYTES - 1)) >> 2;
+    }
+
+    //re-decode words under a store and drop buffered blocks overlapping it
+    void Invalidate(MemPort &port, uint pc, int len) {
+        image.Refresh(pc, port.Fetch(pc & ~3u));
+        if (((pc + len - 1) ^ pc) & ~3u) {
+            image.Refresh(pc + len - 1, port.Fetch((pc + len - 1) & ~3u));
+        }
+        uint l = pc & ~(BYTES - 1), r = (pc + len - 1) & ~(BYTES - 1);
+        for (int i = 0; i < 2; ++i) {
+            if (line[i].addr == l || line[i].addr == r) {
+                line[i].valid = 0;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef FUNCTIONAL_H
+#define FUNCTIONAL_H
+
+#include "tools.h"
+#include "instructions.h"
+#include "memory.h"
+#include "coherence.h"
+#include "syscall.h"
+#include "jit.h"
+
+//in-order functional model without timing, hot basic blocks run as native code
+class Functional_Simulator {
+
+private:
+    uint reg[32], PC;
+    MemPort port;
+    ProxyKernel kernel;
+    JitCache jit;
+
+    enum {
+        HALTED, NEXT, BLOCK_END
+    };
+
+    void StoreMem(uint pc, int len, uint val) {
+        port.Write(pc, len, val);
+        jit.Invalidate(pc);
+        if (((pc + len - 1) ^ pc) & ~3u) {
+            jit.Invalidate(pc + len - 1);
+        }
+    }
+
+    //interpret the instruction at PC
+    int Exec() {
+        Instruction ins = Decode(port.Read(PC, 4));
+        uint a = reg[ins.rs1], b = reg[ins.rs2], val = 0, npc = PC + 4;
+        int ret = NEXT;
+        switch (ins.TYPE) {
+        case LUI:
+            val = ins.imm;
+            break;
+        case AUIPC:
+            val = PC + ins.imm;
+            break;
+        case JAL:
+            val = PC + 4;
+            npc = PC + ins.imm;
+            ret = BLOCK_END;
+            break;
+        case JALR:
+            val = PC + 4;
+            npc = (a + ins.imm) & ~1u;
+            ret = BLOCK_END;
+            break;
+        case BEQ:
+            if (a == b) npc = PC + ins.imm;
+            ret = BLOCK_END;
+            break;
+        case BNE:
+            if (a != b) npc = PC + ins.imm;
+            ret = BLOCK_END;
+            break;
+        case BLT:
+            if ((int)a < (int)b) npc = PC + ins.imm;
+            ret = BLOCK_END;
+            break;
+        case BGE:
+            if ((int)a >= (int)b) npc = PC + ins.imm;
+            ret = BLOCK_END;
+            break;
+        case BLTU:
+            if (a < b) npc = PC + ins.imm;
+            ret = BLOCK_END;
+            break;
+        case BGEU:
+            if (a >= b) npc = PC + ins.imm;
+            ret = BLOCK_END;
+            break;
+        case LB:
+            val = SignExtend(port.Read(a + ins.imm, 1), 8);
+            break;
+        case LH:
+            val = SignExtend(port.Read(a + ins.imm, 2), 16);
+            break;
+        case LW:
+            val = port.Read(a + ins.imm, 4);
+            break;
+        case LBU:
+            val = port.Read(a + ins.imm, 1);
+            break;
+        case LHU:
+            val = port.Read(a + ins.imm, 2);
+            break;
+        case SB:
+            StoreMem(a + ins.imm, 1, b);
+            break;
+        case SH:
+            StoreMem(a + ins.imm, 2, b);
+            break;
+        case SW:
+            StoreMem(a + ins.imm, 4, b);
+            break;
+        case ADDI:
+            val = a + ins.imm;
+            break;
+        case SLTI:
+            val = ((int)a < (int)ins.imm);
+            break;
+        case SLTIU:
+            val = (a < ins.imm);
+            break;
+        case XORI:
+            val = a ^ ins.imm;
+            break;
+        case ORI:
+            val = a | ins.imm;
+            break;
+        case ANDI:
+            val = a & ins.imm;
+            break;
+        case SLLI:
+            val = a << (ins.imm & 31);
+            break;
+        case SRLI:
+            val = a >> (ins.imm & 31);
+            break;
+        case SRAI:
+            val = (int)a >> (ins.imm & 31);
+            break;
+        case ADD:
+            val = a + b;
+            break;
+        case SUB:
+            val = a - b;
+            break;
+        case SLL:
+            val = a << (b & 31);
+            break;
+        case SLT:
+            val = ((int)a < (int)b);
+            break;
+        case SLTU:
+            val = (a < b);
+            break;
+        case XOR:
+            val = a ^ b;
+            break;
+        case SRL:
+            val = a >> (b & 31);
+            break;
+        case SRA:
+            val = (int)a >> (b & 31);
+            break;
+        case OR:
+            val = a | b;
+            break;
+        case AND:
+            val = a & b;
+            break;
+        case ECALL:
+            if (!kernel.Handle(reg, port)) return HALTED;
+            PC = npc;
+            return BLOCK_END;
+        case HALT:
+            return HALTED;
+        default:
+            std::cerr << std::hex << "unknown instruction at " << PC << std::endl;
+            return HALTED;
+        }
+        if (ins.FTYPE != BRANCH && ins.FTYPE != STORE && ins.rd != 0) {
+            reg[ins.rd] = val;
+        }
+        PC = npc;
+        return ret;
+    }
+
+public:
+    Functional_Simulator(): port(new Memory(), nullptr, 0) {
+        memset(reg, 0, sizeof(reg));
+        PC = 0;
+    }
+
+    //start at entry from a copy of an already loaded image
+    Functional_Simulator(const Memory &image, uint entry = 0): port(new Memory(image), nullptr, 0) {
+        memset(reg, 0, sizeof(reg));
+        PC = entry;
+        kernel.Reset(image.top);
+        reg[2] = kernel.Stack(*port.mem, 0);
+    }
+
+    Functional_Simulator(const Functional_Simulator &) = delete;
+    Functional_Simulator & operator = (const Functional_Simulator &) = delete;
+
+    ~Functional_Simulator() {
+        delete port.mem;
+    }
+
+    void input() {
+        port.mem -> Input();
+        kernel.Reset(port.mem -> top);
+        reg[2] = kernel.Stack(*port.mem, 0);
+    }
+
+    //interpret one instruction, return 0 once the program halts
+    bool step() {
+        return Exec() != HALTED;
+    }
+
+    //retire an ECALL that was serviced elsewhere: take its result instead of running it again
+    void skip(uint a0) {
+        reg[10] = a0;
+        PC += 4;
+    }
+
+    uint pc() const {
+        return PC;
+    }
+
+    const uint * regs() const {
+        return reg;
+    }
+
+    Memory & memory() {
+        return *port.mem;
+    }
+
+    //run block by block: native code once a block is hot, the interpreter until then
+    void run() {
+        uint *mem = &(*port.mem)[0];
+        while (871) {
+            JitBlock f = jit.Lookup(PC);
+            if (f == nullptr && jit.Hot(PC)) {
+                f = jit.Compile(*port.mem, PC);
+            }
+            if (f != nullptr) {
+                unsigned long long r = f(reg, mem, jit.Map());
+                PC = (uint)r;
+                if ((r >> 32) == JIT_BAIL) {
+                    if (Exec() == HALTED) break;
+                } else if (r >> 32) {
+                    jit.Invalidate((r >> 32) - 1);
+                }
+                continue;
+            }
+            int st;
+            while ((st = Exec()) == NEXT);
+            if (st == HALTED) break;
+        }
+        kernel.Flush();
+        printf("%u\n", reg[10] & 255u);
+    }
+};
+
+#endif
@@ -45,12 +45,13 @@ enum instruction_t {
     SRA,
     OR,
     AND,
+    ECALL,    //Environment Call
     HALT,
     WOW
 };
 
 enum function_t {
-    IMM, JUMP, BRANCH, LOAD, STORE, CALCI, CALC, RET
+    IMM, JUMP, BRANCH, LOAD, STORE, CALCI, CALC, RET, SYS
 };
 
 const instruction_t Btype[8] = {BEQ, BNE, WOW, WOW, BLT, BGE, BLTU, BGEU};
@@ -63,21 +64,36 @@ struct Instruction {
     instruction_t TYPE;
     function_t FTYPE;
     uint rd, rs1, rs2, imm, pc, pred_pc;
-    Instruction() {}
+    //every field is defined, so two decodings of a word compare equal bit for bit
+    Instruction(): TYPE(WOW), FTYPE(IMM), rd(0), rs1(0), rs2(0), imm(0), pc(0), pred_pc(0) {}
     Instruction(instruction_t _TYPE, uint _rd, uint _rs1, uint _rs2, uint _imm):
-        TYPE(_TYPE), rd(_rd), rs1(_rs1), rs2(_rs2), imm(_imm) {}
+        TYPE(_TYPE), FTYPE(IMM), rd(_rd), rs1(_rs1), rs2(_rs2), imm(_imm), pc(0), pred_pc(0) {}
 };
 
-uint tmp;
+//retirement record handed to commit callbacks, rd is 0 when nothing is written back;
+//a store carries its address and the bits it writes
+struct Retire {
+    uint pc, rd, val;
+    instruction_t op;
+    uint addr, data;
+    Retire() {}
+    Retire(uint _pc, uint _rd, uint _val, instruction_t _op, uint _addr = 0, uint _data = 0):
+        pc(_pc), rd(_rd), val(_val), op(_op), addr(_addr), data(_data) {}
+};
+
+//the part of rs2 a store writes to memory
+inline uint StoreData(instruction_t op, uint x) {
+    return op == SB? (x & 0xFF) : op == SH? (x & 0xFFFF) : x;
+}
 
-Instruction Decode(uint ins) {
-    Instruction cur;
+inline Instruction Decode(uint ins) {
+    Instruction cur;    //fields a format does not use stay 0
     if (ins == 0x0ff00513) {
         cur.TYPE = HALT;
 		cur.FTYPE = RET;
         return cur;
     }
-    uint opcode = ExtractBits(ins, 0, 6), func3;
+    uint opcode = ExtractBits(ins, 0, 6), func3, tmp;
     switch(opcode) {
     case 0x37:
         cur.TYPE = LUI;
@@ -164,6 +180,14 @@ Instruction Decode(uint ins) {
         cur.rs1 = ExtractBits(ins, 15, 19);
         cur.rs2 = ExtractBits(ins, 20, 24);
         break;
+    case 0x73:
+        if (ins == 0x00000073) {
+            cur.TYPE = ECALL;
+            cur.FTYPE = SYS;
+        } else {
+            cur.TYPE = WOW;
+        }
+        break;
     default:
         cur.TYPE = WOW;
 //std::cerr << "WOW" << std::endl;
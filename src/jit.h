@@ -0,0 +1,410 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "tools.h"
+#include "instructions.h"
+#include "memory.h"
+#include "decoder.h"
+
+#include <cassert>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define JIT_ENABLED
+#endif
+
+const int JIT_HOT = 16;             //block entries before a block is compiled
+const int JIT_MAX_BLOCK = 64;       //guest instructions per block
+const int JIT_CODE_SIZE = 1 << 24;
+const int JIT_INSN_BYTES = 192;     //native code of one guest instruction, a SW is the longest at 173
+const int JIT_EXIT_BYTES = 6;       //mov eax, pc; ret closing a block that falls through
+
+//rdi = reg, rsi = mem, rdx = code map; returns the next pc, and the written address + 1
+//in the high half when a store hit compiled code, or JIT_BAIL when the access at pc
+//falls outside memory and is left to the interpreter
+const unsigned long long JIT_BAIL = 0xFFFFFFFFull;
+
+typedef unsigned long long (*JitBlock)(uint *reg, uint *mem, const uchar *map);
+
+class JitCache {
+
+private:
+    //x86 registers used by the generated code
+    enum {
+        EAX = 0, ECX = 1, R8 = 8, R9 = 9
+    };
+    //condition codes
+    enum {
+        CC_B = 2, CC_AE = 3, CC_E = 4, CC_NE = 5, CC_L = 0xC, CC_GE = 0xD
+    };
+
+    uchar *code;
+    int used;
+    JitBlock *entry;
+    ushort *heat;
+    uchar *map;     //compiled blocks covering each word
+    std::vector< Pair<uint, uint> > blocks;
+
+    void Byte(uchar x) {
+        code[used++] = x;
+    }
+
+    void Dword(uint x) {
+        for (int i = 0; i < 4; ++i) {
+            Byte(x >> (i << 3));
+        }
+    }
+
+    void Rex(int w, int r, int b) {
+        if (w || r >= 8 || b >= 8) {
+            Byte(0x40 | (w << 3) | ((r >> 3) << 2) | (b >> 3));
+        }
+    }
+
+    //mov x, reg[r]
+    void LoadReg(int x, uint r) {
+        Rex(0, x, 0);
+        Byte(0x8B);
+        Byte(0x47 | ((x & 7) << 3));
+        Byte(r << 2);
+    }
+
+    //mov reg[r], x
+    void StoreReg(uint r, int x) {
+        if (r == 0) return;
+        Rex(0, x, 0);
+        Byte(0x89);
+        Byte(0x47 | ((x & 7) << 3));
+        Byte(r << 2);
+    }
+
+    void MovImm(int x, uint imm) {
+        Rex(0, 0, x);
+        Byte(0xB8 | (x & 7));
+        Dword(imm);
+    }
+
+    //op dst, src for the 01 /r family (add 01, or 09, and 21, sub 29, xor 31, cmp 39, mov 89)
+    void Alu(uchar op, int dst, int src) {
+        Rex(0, src, dst);
+        Byte(op);
+        Byte(0xC0 | ((src & 7) << 3) | (dst & 7));
+    }
+
+    //op dst, imm32 for the 81 /digit family (add 0, or 1, and 4, sub 5, xor 6, cmp 7)
+    void AluImm(int digit, int dst, uint imm) {
+        Rex(0, 0, dst);
+        Byte(0x81);
+        Byte(0xC0 | (digit << 3) | (dst & 7));
+        Dword(imm);
+    }
+
+    //shl 4, shr 5, sar 7
+    void ShiftImm(int digit, int dst, int n) {
+        Rex(0, 0, dst);
+        Byte(0xC1);
+        Byte(0xC0 | (digit << 3) | (dst & 7));
+        Byte(n);
+    }
+
+    void ShiftCl(int digit, int dst) {
+        Rex(0, 0, dst);
+        Byte(0xD3);
+        Byte(0xC0 | (digit << 3) | (dst & 7));
+    }
+
+    //setcc al; movzx eax, al
+    void SetEax(int cc) {
+        Byte(0x0F);
+        Byte(0x90 | cc);
+        Byte(0xC0);
+        Byte(0x0F);
+        Byte(0xB6);
+        Byte(0xC0);
+    }
+
+    //mov x, mem[rcx + k] / mov mem[rcx + k], x
+    void MemOp(uchar op, int x, int k) {
+        Rex(0, x, 0);
+        Byte(op);
+        Byte(0x44 | ((x & 7) << 3));
+        Byte(0x8E);
+        Byte(k << 2);
+    }
+
+    //leave the block at pc unless rcx .. rcx + len - 1 is inside memory
+    void CheckRange(int len, uint pc) {
+        AluImm(7, ECX, MEM_SIZE - len);
+        Byte(0x76);     //jbe over the exit
+        Byte(11);
+        Byte(0x48);     //mov rax, JIT_BAIL << 32 | pc
+        Byte(0xB8);
+        Dword(pc);
+        Dword(JIT_BAIL);
+        Byte(0xC3);
+    }
+
+    void Load(int len, bool sign, uint pc) {
+        CheckRange(len, pc);
+        MemOp(0x8B, EAX, 0);
+        for (int k = 1; k < len; ++k) {
+            MemOp(0x8B, R8, k);
+            ShiftImm(4, R8, k << 3);
+            Alu(0x09, EAX, R8);
+        }
+        if (sign && len < 4) {
+            Byte(0x0F);
+            Byte(len == 1? 0xBE : 0xBF);
+            Byte(0xC0);
+        }
+    }
+
+    //leave the block at npc if the word of rcx + off holds compiled code
+    void CheckCode(uint npc, int off) {
+        Alu(0x89, R9, ECX);
+        if (off) AluImm(0, R9, off);
+        ShiftImm(5, R9, 2);
+        Byte(0x42);     //cmp byte [rdx + r9], 0
+        Byte(0x80);
+        Byte(0x3C);
+        Byte(0x0A);
+        Byte(0x00);
+        Byte(0x74);     //je over the exit
+        Byte(17);
+        MovImm(EAX, npc);
+        Byte(0x4C);     //lea r9, [rcx + 1]
+        Byte(0x8D);
+        Byte(0x49);
+        Byte(0x01);
+        Byte(0x49);     //shl r9, 32
+        Byte(0xC1);
+        Byte(0xE1);
+        Byte(0x20);
+        Byte(0x4C);     //or rax, r9
+        Byte(0x09);
+        Byte(0xC8);
+        Byte(0xC3);
+    }
+
+    void Store(int len, uint pc) {
+        CheckRange(len, pc);
+        for (int k = 0; k < len; ++k) {
+            Alu(0x89, R9, R8);
+            if (k) ShiftImm(5, R9, k << 3);
+            AluImm(4, R9, 0xFF);
+            MemOp(0x89, R9, k);
+        }
+        CheckCode(pc + 4, 0);
+        if (len > 1) CheckCode(pc + 4, len - 1);
+    }
+
+    //cmp ecx, r8d; eax = cond? target : pc + 4
+    void Branch(int cc, uint pc, uint target) {
+        Alu(0x39, ECX, R8);
+        MovImm(EAX, pc + 4);
+        MovImm(R9, target);
+        Rex(0, EAX, R9);
+        Byte(0x0F);
+        Byte(0x40 | cc);
+        Byte(0xC0 | (R9 & 7));
+        Byte(0xC3);
+    }
+
+    //emit one instruction: 1 to go on, 0 if it ended the block, -1 if it is left to the interpreter
+    int Emit(const Instruction &ins, uint pc) {
+        switch (ins.TYPE) {
+        case LUI:
+            MovImm(EAX, ins.imm);
+            StoreReg(ins.rd, EAX);
+            return 1;
+        case AUIPC:
+            MovImm(EAX, pc + ins.imm);
+            StoreReg(ins.rd, EAX);
+            return 1;
+        case JAL:
+            MovImm(EAX, pc + 4);
+            StoreReg(ins.rd, EAX);
+            MovImm(EAX, pc + ins.imm);
+            Byte(0xC3);
+            return 0;
+        case JALR:
+            LoadReg(ECX, ins.rs1);
+            AluImm(0, ECX, ins.imm);
+            AluImm(4, ECX, ~1u);
+            MovImm(EAX, pc + 4);
+            StoreReg(ins.rd, EAX);
+            Alu(0x89, EAX, ECX);
+            Byte(0xC3);
+            return 0;
+        case BEQ: case BNE: case BLT: case BGE: case BLTU: case BGEU: {
+            static const int cc[] = {CC_E, CC_NE, CC_L, CC_GE, CC_B, CC_AE};
+            LoadReg(ECX, ins.rs1);
+            LoadReg(R8, ins.rs2);
+            Branch(cc[ins.TYPE - BEQ], pc, pc + ins.imm);
+            return 0;
+        }
+        case LB: case LH: case LW: case LBU: case LHU:
+            LoadReg(ECX, ins.rs1);
+            if (ins.imm) AluImm(0, ECX, ins.imm);
+            Load(ins.TYPE == LW? 4 : (ins.TYPE == LH || ins.TYPE == LHU)? 2 : 1, ins.TYPE == LB || ins.TYPE == LH, pc);
+            StoreReg(ins.rd, EAX);
+            return 1;
+        case SB: case SH: case SW:
+            LoadReg(ECX, ins.rs1);
+            if (ins.imm) AluImm(0, ECX, ins.imm);
+            LoadReg(R8, ins.rs2);
+            Store(ins.TYPE == SW? 4 : ins.TYPE == SH? 2 : 1, pc);
+            return 1;
+        case ADDI: case XORI: case ORI: case ANDI: {
+            static const int digit[] = {0, 6, 1, 4};
+            LoadReg(EAX, ins.rs1);
+            AluImm(digit[ins.TYPE == ADDI? 0 : ins.TYPE - XORI + 1], EAX, ins.imm);
+            StoreReg(ins.rd, EAX);
+            return 1;
+        }
+        case SLTI: case SLTIU:
+            LoadReg(EAX, ins.rs1);
+            AluImm(7, EAX, ins.imm);
+            SetEax(ins.TYPE == SLTI? CC_L : CC_B);
+            StoreReg(ins.rd, EAX);
+            return 1;
+        case SLLI: case SRLI: case SRAI:
+            LoadReg(EAX, ins.rs1);
+            ShiftImm(ins.TYPE == SLLI? 4 : ins.TYPE == SRLI? 5 : 7, EAX, ins.imm & 31);
+            StoreReg(ins.rd, EAX);
+            return 1;
+        case ADD: case SUB: case XOR: case OR: case AND: {
+            LoadReg(EAX, ins.rs1);
+            LoadReg(R8, ins.rs2);
+            Alu(ins.TYPE == ADD? 0x01 : ins.TYPE == SUB? 0x29 : ins.TYPE == XOR? 0x31 : ins.TYPE == OR? 0x09 : 0x21, EAX, R8);
+            StoreReg(ins.rd, EAX);
+            return 1;
+        }
+        case SLT: case SLTU:
+            LoadReg(EAX, ins.rs1);
+            LoadReg(R8, ins.rs2);
+            Alu(0x39, EAX, R8);
+            SetEax(ins.TYPE == SLT? CC_L : CC_B);
+            StoreReg(ins.rd, EAX);
+            return 1;
+        case SLL: case SRL: case SRA:
+            LoadReg(EAX, ins.rs1);
+            LoadReg(ECX, ins.rs2);
+            ShiftCl(ins.TYPE == SLL? 4 : ins.TYPE == SRL? 5 : 7, EAX);
+            StoreReg(ins.rd, EAX);
+            return 1;
+        default:
+            return -1;
+        }
+    }
+
+    //blocks start cold again, so the hot ones are compiled into the emptied buffer
+    void Flush() {
+        used = 0;
+        blocks.clear();
+        memset(entry, 0, sizeof(JitBlock) * CODE_WORDS);
+        memset(heat, 0, sizeof(ushort) * CODE_WORDS);
+        memset(map, 0, CODE_WORDS + 1);
+    }
+
+public:
+    JitCache() {
+        code = nullptr;
+#ifdef JIT_ENABLED
+        void *p = mmap(nullptr, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            code = (uchar *)p;
+        }
+#endif
+        entry = new JitBlock[CODE_WORDS];
+        heat = new ushort[CODE_WORDS];
+        map = new uchar[CODE_WORDS + 1];
+        Flush();
+    }
+
+    ~JitCache() {
+#ifdef JIT_ENABLED
+        if (code != nullptr) {
+            munmap(code, JIT_CODE_SIZE);
+        }
+#endif
+        delete [] entry;
+        delete [] heat;
+        delete [] map;
+    }
+
+    bool enabled() const {
+        return code != nullptr;
+    }
+
+    const uchar * Map() const {
+        return map;
+    }
+
+    //addresses outside memory never hold a block
+    JitBlock Lookup(uint pc) const {
+        if ((pc >> 2) >= (uint)CODE_WORDS) return nullptr;
+        return entry[pc >> 2];
+    }
+
+    //count an entry into the block at pc, true once it turns hot
+    bool Hot(uint pc) {
+        if ((pc >> 2) >= (uint)CODE_WORDS) return 0;
+        ushort &h = heat[pc >> 2];
+        if (h <= JIT_HOT) ++h;
+        return h == JIT_HOT;
+    }
+
+    //translate the basic block at pc, stop before anything the interpreter must handle
+    JitBlock Compile(Memory &mem, uint pc) {
+        if (code == nullptr) return nullptr;
+        if (used + JIT_INSN_BYTES + JIT_EXIT_BYTES > JIT_CODE_SIZE) Flush();
+        int start = used, ret = 1;
+        uint p = pc;
+        for (int n = 0; n < JIT_MAX_BLOCK && ret == 1; ++n) {
+            //a buffer about to run out ends the block early
+            if (used + JIT_INSN_BYTES + JIT_EXIT_BYTES > JIT_CODE_SIZE) break;
+            int mark = used;
+            ret = Emit(Decode(mem.Read(p, 4)), p);
+            assert(used - mark <= JIT_INSN_BYTES);
+            if (ret == -1) {
+                used = mark;
+            } else {
+                p += 4;
+            }
+        }
+        if (p == pc) {
+            used = start;
+            return nullptr;
+        }
+        if (ret != 0) {
+            //fell out of the block without a jump: return the next pc
+            MovImm(EAX, p);
+            Byte(0xC3);
+        }
+        for (uint w = pc >> 2; w < (p >> 2); ++w) {
+            ++map[w];
+        }
+        blocks.push_back(Pair<uint, uint>(pc, p));
+        entry[pc >> 2] = (JitBlock)(code + start);
+        return entry[pc >> 2];
+    }
+
+    //drop every block covering the word written at addr
+    void Invalidate(uint addr) {
+        uint lo = addr >> 2, hi = (addr + 3) >> 2;
+        if (lo >= (uint)CODE_WORDS || (!map[lo] && !map[hi])) return;
+        for (auto &b : blocks) {
+            if (b.first == b.second || (b.second >> 2) <= lo || (b.first >> 2) > hi) continue;
+            entry[b.first >> 2] = nullptr;
+            heat[b.first >> 2] = 0;
+            for (uint w = b.first >> 2; w < (b.second >> 2); ++w) {
+                --map[w];
+            }
+            b.first = b.second;
+        }
+    }
+};
+
+#endif
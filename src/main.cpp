@@ -1,16 +1,90 @@
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
 #include "tomasulo.h"
+#include "multicore.h"
+#include "functional.h"
+#include "runner.h"
 
 //#define LOCAL
 
-int main() {
+struct ConfigEntry {
+    const char *name;
+    int (*run)(const SimOptions &);
+};
+
+const ConfigEntry CONFIGS[] = {
+    {"default", RunTomasulo<DefaultConfig>},
+    {"small", RunTomasulo<SmallConfig>},
+    {"wide", RunTomasulo<WideConfig>},
+    {"static", RunTomasulo<StaticConfig>}
+};
+const int CONFIG_CNT = sizeof(CONFIGS) / sizeof(CONFIGS[0]);
+
+int main(int argc, char **argv) {
 
 #ifdef LOCAL
     freopen("testcases/bulgarian.data", "r", stdin);
 #endif
 
-    Tomasulo_Simulator s;
-    s.input();
-    s.run();
+    int cores = 1, quantum = 1000;
+    bool functional = 0;
+    const char *trace = nullptr;
+    bool check = 0;
+    int prefetch = -1, vpred = -1, config = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--functional")) {
+            functional = 1;
+        } else if (!strcmp(argv[i], "--cores") && i + 1 < argc) {
+            cores = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--quantum") && i + 1 < argc) {
+            quantum = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--check")) {
+            check = 1;
+        } else if (!strcmp(argv[i], "--prefetch") && i + 1 < argc) {
+            const char *mode[] = {"none", "stride", "stream", "both"};
+            ++i;
+            for (int k = 0; k < 4; ++k) {
+                if (!strcmp(argv[i], mode[k])) prefetch = k;
+            }
+            if (prefetch == -1) prefetch = -2;
+        } else if (!strcmp(argv[i], "--vpred") && i + 1 < argc) {
+            ++i;
+            vpred = (!strcmp(argv[i], "last")? VP_LAST : !strcmp(argv[i], "stride")? VP_STRIDE : -2);
+        } else if (!strcmp(argv[i], "--config") && i + 1 < argc) {
+            ++i;
+            config = -1;
+            for (int k = 0; k < CONFIG_CNT; ++k) {
+                if (!strcmp(argv[i], CONFIGS[k].name)) config = k;
+            }
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            trace = argv[++i];
+        }
+    }
+    if (cores < 1 || cores > MAX_CORES || quantum < 1 || (functional && (cores > 1 || trace != nullptr)) || ((check || prefetch != -1 || vpred != -1 || config != 0) && (functional || cores > 1)) || prefetch == -2 || vpred == -2 || config == -1) {
+        std::cerr << "usage: code [--functional | [--config default|small|wide|static] [--check] [--prefetch none|stride|stream|both] [--vpred last|stride] [--trace file] | [--trace file] --cores 1.." << MAX_CORES << " [--quantum cycles]]" << std::endl;
+        return 1;
+    }
+
+    if (functional) {
+        Functional_Simulator s;
+        s.input();
+        s.run();
+    } else if (cores == 1) {
+        SimOptions opt;
+        opt.trace = trace;
+        opt.check = check;
+        opt.prefetch = prefetch;
+        opt.vpred = vpred;
+        return CONFIGS[config].run(opt);
+    } else {
+        MultiCore_Simulator s(cores, quantum);
+        if (trace != nullptr && !s.trace(trace)) {
+            std::cerr << "cannot open " << trace << std::endl;
+            return 1;
+        }
+        s.input();
+        s.run();
+    }
     return 0;
 }
\ No newline at end of file
@@ -3,17 +3,23 @@
 
 #include "tools.h"
 
+const int MEM_SIZE = 500005;
+
 class Memory {
 
 private:
-    uint mem[500005];
+    uint mem[MEM_SIZE];
 
 public:
+    uint top;   //end of the loaded image
+
     uint & operator [] (const int &pos) {
         return mem[pos];
     }
 
-    inline uint Read(int pc, int len) {
+    //wrong-path accesses may carry any address, those outside memory read 0 and write nothing
+    inline uint Read(int pc, int len) const {
+        if ((uint)pc > (uint)(MEM_SIZE - len)) return 0;
         uint ret = 0;
         for (int i = 0; i < len; ++i) {
             ret |= (mem[pc + i] << (i << 3));
@@ -22,11 +28,39 @@ public:
     }
 
     inline void Write(int pc, int len, uint val) {
+        if ((uint)pc > (uint)(MEM_SIZE - len)) return;
         for (int i = 0; i < len; ++i) {
             mem[pc + i] = (val & 0xFF);
             val >>= 8;
         }
     }
+
+    //copy a raw image to base
+    void Load(const uchar *image, uint len, uint base) {
+        for (uint i = 0; i < len && base + i < (uint)MEM_SIZE; ++i) {
+            mem[base + i] = image[i];
+        }
+        if (base + len > top) top = base + len;
+    }
+
+    //one uint per byte, valid up to MEM_SIZE
+    const uint * Data() const {
+        return mem;
+    }
+
+    //read a hex image from stdin
+    void Input() {
+        char s[100];
+        int ptr = 0;
+        while (scanf("%s", s) != EOF) {
+            if (s[0] == '@') {
+                ptr = Translate(s + 1);
+            } else {
+                mem[ptr++] = Translate(s);
+                if ((uint)ptr > top) top = ptr;
+            }
+        }
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,123 @@
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include "tools.h"
+#include "memory.h"
+#include "coherence.h"
+#include "tomasulo.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//reusable barrier, the last arriver decides whether every core has halted
+class Barrier {
+
+private:
+    std::mutex lock;
+    std::condition_variable cv;
+    int n, arrived, halted, gen;
+    bool all_halted;
+
+public:
+    Barrier(int _n): n(_n), arrived(0), halted(0), gen(0), all_halted(0) {}
+
+    bool Arrive(bool done) {
+        std::unique_lock<std::mutex> guard(lock);
+        int my_gen = gen;
+        halted += done;
+        if (++arrived == n) {
+            all_halted = (halted == n);
+            arrived = halted = 0;
+            ++gen;
+            cv.notify_all();
+        } else {
+            cv.wait(guard, [&] { return gen != my_gen; });
+        }
+        return all_halted;
+    }
+};
+
+//n out-of-order cores on their own host threads, synchronized every quantum cycles
+class MultiCore_Simulator {
+
+private:
+    int n, quantum;
+    Memory *mem;
+    Directory *dir;
+    vector<Tomasulo_Simulator<> *> core;
+
+    void Worker(int id, Barrier &barrier) {
+        bool done = 0;
+        do {
+            for (int i = 0; i < quantum && !done; ++i) {
+                done = !core[id] -> step();
+            }
+        } while (!barrier.Arrive(done));
+    }
+
+public:
+    MultiCore_Simulator(int _n, int _quantum): n(_n), quantum(_quantum) {
+        mem = new Memory();
+        dir = new Directory();
+        for (int i = 0; i < n; ++i) {
+            core.push_back(new Tomasulo_Simulator<>(*mem, *dir, i));
+        }
+    }
+
+    MultiCore_Simulator(const MultiCore_Simulator &) = delete;
+    MultiCore_Simulator & operator = (const MultiCore_Simulator &) = delete;
+
+    ~MultiCore_Simulator() {
+        for (auto x : core) {
+            delete x;
+        }
+        delete dir;
+        delete mem;
+    }
+
+    //one log per core, path.<hart>
+    bool trace(const std::string &path) {
+        for (int i = 0; i < n; ++i) {
+            if (!core[i] -> trace(path + "." + std::to_string(i))) return 0;
+        }
+        return 1;
+    }
+
+    void input() {
+        mem -> Input();
+        for (auto x : core) {
+            x -> load();
+        }
+    }
+
+    void run() {
+        Barrier barrier(n);
+        vector<std::thread> threads;
+        for (int i = 0; i < n; ++i) {
+            threads.emplace_back(&MultiCore_Simulator::Worker, this, i, std::ref(barrier));
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+        printf("%u\n", core[0] -> result());
+        report(std::cerr);
+    }
+
+    //coherence traffic of each core, and its trace when one is written
+    void report(std::ostream &os) const {
+        for (int i = 0; i < n; ++i) {
+            os << "core " << i << " coherence misses: " << dir -> miss_cnt[i]
+               << " invalidations: " << dir -> invalidate_cnt[i]
+               << " writebacks: " << dir -> writeback_cnt[i] << std::endl;
+            if (core[i] -> pipe_tracer() != nullptr) {
+                os << "core " << i << ' ';
+                core[i] -> pipe_tracer() -> Report(os);
+            }
+        }
+    }
+};
+
+#endif
@@ -3,20 +3,24 @@
 
 #include "tools.h"
 
+//saturating counters per pc, SIZ a power of two
+template <int SIZ>
 class BranchPredictor {
 public:
+    static_assert((SIZ & (SIZ - 1)) == 0, "predictor size must be a power of two");
+
     BranchPredictor() {
-        for (int i = 0; i < 4096; ++i) {
+        for (int i = 0; i < SIZ; ++i) {
             cnt[i] = 1;
             res[i] = 0;
         }
     }
 
-    bool res[4096];
-    uchar cnt[4096];
+    bool res[SIZ];
+    uchar cnt[SIZ];
 
     void update(uint pc, bool x) {
-        pc &= 4095;
+        pc &= SIZ - 1;
         if (x == res[pc]) {
             if (cnt[pc] < 4) ++cnt[pc];
         } else {
@@ -29,7 +33,17 @@ public:
     }
 
     bool predict(uint pc) {
-        return res[pc & 4095];
+        return res[pc & (SIZ - 1)];
+    }
+};
+
+//never taken, a baseline for the dynamic predictor
+class StaticPredictor {
+public:
+    void update(uint, bool) {}
+
+    bool predict(uint) {
+        return 0;
     }
 };
 
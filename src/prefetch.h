@@ -0,0 +1,164 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "tools.h"
+#include "buffer.h"
+#include "coherence.h"
+
+const int STRIDE_ENTRIES = 64;  //pc-indexed, direct mapped
+const int STREAMS = 8;
+const int PF_DEGREE = 2;        //lines requested per trigger
+const int PF_QUEUE = 16;
+
+enum prefetch_t {
+    PF_NONE, PF_STRIDE, PF_STREAM, PF_BOTH
+};
+
+//per-load-pc stride detection, confident after the same stride is seen twice
+class StrideTable {
+
+private:
+    struct Entry {
+        uint pc, last;
+        int stride;
+        uchar conf;
+        bool valid;
+        Entry() {
+            valid = 0;
+        }
+    } a[STRIDE_ENTRIES];
+
+public:
+    //train on a load, return the stride once it is trusted, 0 otherwise
+    int train(uint pc, uint addr) {
+        Entry &e = a[(pc >> 2) & (STRIDE_ENTRIES - 1)];
+        if (!e.valid || e.pc != pc) {
+            e.valid = 1;
+            e.pc = pc;
+            e.last = addr;
+            e.stride = 0;
+            e.conf = 0;
+            return 0;
+        }
+        int stride = addr - e.last;
+        e.last = addr;
+        if (stride == e.stride) {
+            if (e.conf < 3) ++e.conf;
+        } else if (e.conf > 0) {
+            --e.conf;
+        } else {
+            e.stride = stride;
+        }
+        return (e.conf >= 2? e.stride : 0);
+    }
+};
+
+//sequential line streams seen among misses, up or down
+class StreamDetector {
+
+private:
+    struct Entry {
+        uint line;      //last line of the stream
+        int dir;
+        uchar conf;
+        LL lru;
+        bool valid;
+        Entry() {
+            valid = 0;
+        }
+    } a[STREAMS];
+    LL stamp;
+
+public:
+    StreamDetector() {
+        stamp = 0;
+    }
+
+    //train on a missing line, return the direction of a confirmed stream, 0 otherwise
+    int train(uint line) {
+        ++stamp;
+        int victim = 0;
+        for (int i = 0; i < STREAMS; ++i) {
+            Entry &e = a[i];
+            if (e.valid && (line == e.line + 1 || line == e.line - 1)) {
+                int dir = (line == e.line + 1? 1 : -1);
+                if (dir != e.dir) {
+                    e.dir = dir;
+                    e.conf = 1;
+                } else if (e.conf < 3) {
+                    ++e.conf;
+                }
+                e.line = line;
+                e.lru = stamp;
+                return (e.conf >= 2? dir : 0);
+            }
+            if (!e.valid) {
+                victim = i;
+            } else if (a[victim].valid && e.lru < a[victim].lru) {
+                victim = i;
+            }
+        }
+        Entry &e = a[victim];
+        e.valid = 1;
+        e.line = line;
+        e.dir = 0;
+        e.conf = 0;
+        e.lru = stamp;
+        return 0;
+    }
+};
+
+//turns trained patterns into line requests for the data cache
+class Prefetcher {
+
+private:
+    prefetch_t mode;
+    StrideTable stride;
+    StreamDetector stream;
+
+    void Request(uint line) {
+        if (line >= (uint)LINES) return;
+        if (queue.full()) {
+            ++drop_cnt;
+            return;
+        }
+        queue.push(line);
+    }
+
+public:
+    Queue<uint, PF_QUEUE> queue;    //line numbers waiting to be sent
+    LL drop_cnt;
+
+    Prefetcher(prefetch_t _mode): mode(_mode), drop_cnt(0) {}
+
+    prefetch_t type() const {
+        return mode;
+    }
+
+    //every executed load trains the stride table
+    void OnLoad(uint pc, uint addr) {
+        if (mode != PF_STRIDE && mode != PF_BOTH) return;
+        int s = stride.train(pc, addr);
+        if (s == 0) return;
+        uint line = addr >> LINE_BITS;
+        for (int k = 1; k <= PF_DEGREE; ++k) {
+            //strides inside a line walk line by line instead
+            if (s < (1 << LINE_BITS) && s > -(1 << LINE_BITS)) {
+                Request(line + (s > 0? k : -k));
+            } else {
+                Request((addr + s * k) >> LINE_BITS);
+            }
+        }
+    }
+
+    //misses, and first touches of prefetched lines, train the streams
+    void OnMiss(uint line) {
+        if (mode != PF_STREAM && mode != PF_BOTH) return;
+        int dir = stream.train(line);
+        for (int k = 1; dir != 0 && k <= PF_DEGREE; ++k) {
+            Request(line + dir * k);
+        }
+    }
+};
+
+#endif
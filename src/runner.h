@@ -0,0 +1,48 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include "tools.h"
+#include "config.h"
+#include "tomasulo.h"
+
+//command line options of a single-core run
+struct SimOptions {
+    const char *trace;
+    bool check;
+    int prefetch, vpred;    //-1 when off
+};
+
+template <class Config>
+int RunTomasulo(const SimOptions &opt) {
+    Tomasulo_Simulator<Config> s;
+    if (opt.trace != nullptr && !s.trace(opt.trace)) {
+        std::cerr << "cannot open " << opt.trace << std::endl;
+        return 1;
+    }
+    s.input();
+    if (opt.check) s.check();
+    if (opt.prefetch >= 0) s.prefetch((prefetch_t)opt.prefetch);
+    if (opt.vpred >= 0) s.predict_values((vpred_t)opt.vpred);
+    s.run();
+    if (opt.prefetch >= 0 || opt.vpred >= 0) {
+        std::cerr << "cycles: " << s.cycles() << std::endl;
+    }
+    if (opt.trace != nullptr) {
+        s.pipe_tracer() -> Report(std::cerr);
+    }
+    if (opt.prefetch >= 0) {
+        s.data_cache() -> Report(std::cerr);
+    }
+    if (opt.vpred >= 0) {
+        s.value_predictor() -> Report(std::cerr);
+    }
+    return s.diverged()? 1 : 0;
+}
+
+//compiled once per configuration next to its Tomasulo_Simulator, in config_*.cpp
+extern template int RunTomasulo<DefaultConfig>(const SimOptions &);
+extern template int RunTomasulo<SmallConfig>(const SimOptions &);
+extern template int RunTomasulo<WideConfig>(const SimOptions &);
+extern template int RunTomasulo<StaticConfig>(const SimOptions &);
+
+#endif
@@ -15,10 +15,10 @@ struct RSInfo {
     }
 };
 
+template <int SIZ>
 class ReservationStation {
 
 public:
-    static const int SIZ = 30;
     RSInfo a[SIZ];
 
     ReservationStation() {
@@ -42,9 +42,18 @@ public:
         return 1;
     }
 
-    int front() const {
+    int size() const {
+        int ret = 0;
         for (int i = 0; i < SIZ; ++i) {
-            if (a[i].busy) {
+            ret += a[i].busy;
+        }
+        return ret;
+    }
+
+    //first entry whose operands have all arrived, -1 if none
+    int pick() const {
+        for (int i = 0; i < SIZ; ++i) {
+            if (a[i].busy && a[i].qj == -1 && a[i].qk == -1) {
                 return i;
             }
         }
@@ -55,6 +64,7 @@ public:
         for (int i = 0; i < SIZ; ++i) {
             if (!a[i].busy) {
                 a[i] = x;
+                break;
             }
         }
     }
@@ -71,7 +81,6 @@ public:
                     a[i].vk = x;
                 }
             }
-            if (++i == QSIZ) i = 0;
         }
     }
 };
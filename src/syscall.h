@@ -0,0 +1,179 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include "tools.h"
+#include "memory.h"
+#include "coherence.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+
+//riscv newlib / proxy kernel syscall numbers
+const int SYS_CLOSE = 57;
+const int SYS_READ = 63;
+const int SYS_WRITE = 64;
+const int SYS_FSTAT = 80;
+const int SYS_EXIT = 93;
+const int SYS_EXIT_GROUP = 94;
+const int SYS_CLOCK_GETTIME = 113;
+const int SYS_BRK = 214;
+
+const int STAT_SIZE = 128;      //sizeof(struct kernel_stat) in libgloss
+const int STAT_MODE = 16;
+const uint STAT_IFCHR = 0020000;
+
+const int OUT_BUF = 1 << 16;
+
+const uint STACK_TOP = (uint)MEM_SIZE & ~15u;
+const uint HART_STACK = 1 << 12;    //stack of each hart, hart 0's ends at STACK_TOP
+const uint STACK_ARGS = 32;         //argc, argv and envp terminators, an empty auxv
+const uint HEAP_TOP = STACK_TOP - MAX_CORES * HART_STACK;   //the heap stays under the lowest hart stack
+static_assert(MAX_CORES * HART_STACK < STACK_TOP, "every hart needs a stack");
+
+//services ECALL at commit: a7 holds the number, a0-a2 the arguments, a0 gets the result
+class ProxyKernel {
+
+private:
+    char out[OUT_BUF];
+    int out_len;
+    uint brk;   //heap base, and the break itself when the memory is private
+
+    static bool Valid(uint addr, uint len) {
+        return addr <= (uint)MEM_SIZE && len <= (uint)MEM_SIZE - addr;
+    }
+
+    int Write(MemPort &port, uint fd, uint buf, uint len) {
+        if (fd != 1 && fd != 2) return -EBADF;
+        if (!Valid(buf, len)) return -EFAULT;
+        if (fd == 2) {
+            Flush();
+            for (uint i = 0; i < len; ++i) {
+                fputc(port.Read(buf + i, 1), stderr);
+            }
+            return len;
+        }
+        for (uint i = 0; i < len; ++i) {
+            if (out_len == OUT_BUF) Flush();
+            out[out_len++] = port.Read(buf + i, 1);
+        }
+        return len;
+    }
+
+    //host stdin is passed through; the command line reads the image from it up to EOF,
+    //so there guests only ever see the end of it, library users keep stdin to themselves
+    int Read(MemPort &port, uint fd, uint buf, uint len) {
+        if (fd != 0) return -EBADF;
+        if (!Valid(buf, len)) return -EFAULT;
+        uint i = 0;
+        for (int c; i < len && (c = getchar()) != EOF; ++i) {
+            port.Write(buf + i, 1, c);
+        }
+        return i;
+    }
+
+    int Fstat(MemPort &port, uint fd, uint buf) {
+        if (fd > 2) return -EBADF;
+        if (!Valid(buf, STAT_SIZE)) return -EFAULT;
+        for (int i = 0; i < STAT_SIZE; i += 4) {
+            port.Write(buf + i, 4, 0);
+        }
+        port.Write(buf + STAT_MODE, 4, STAT_IFCHR);
+        return 0;
+    }
+
+    //timespec with a 64-bit tv_sec and a 32-bit tv_nsec
+    int ClockGettime(MemPort &port, uint id, uint buf) {
+        if (!Valid(buf, 12)) return -EFAULT;
+        std::chrono::nanoseconds t;
+        if (id == 0) {
+            t = std::chrono::system_clock::now().time_since_epoch();
+        } else {
+            t = std::chrono::steady_clock::now().time_since_epoch();
+        }
+        LL ns = t.count();
+        port.Write(buf, 4, ns / 1000000000);
+        port.Write(buf + 4, 4, (ns / 1000000000) >> 32);
+        port.Write(buf + 8, 4, ns % 1000000000);
+        return 0;
+    }
+
+    uint Brk(MemPort &port, uint addr) {
+        if (port.dir != nullptr) {
+            return port.dir -> Brk(brk, addr, HEAP_TOP);
+        }
+        if (addr >= brk && addr <= HEAP_TOP) {
+            brk = addr;
+        }
+        return brk;
+    }
+
+public:
+    ProxyKernel() {
+        out_len = 0;
+        brk = 0;
+    }
+
+    ~ProxyKernel() {
+        Flush();
+    }
+
+    //heap starts right after the loaded image
+    void Reset(uint top) {
+        brk = (top + 15) & ~15u;
+    }
+
+    //lay out the stack a newlib crt0 expects at reset: argc = 0 at sp, a null argv
+    //and envp, an empty auxv; return sp
+    uint Stack(Memory &mem, int hart) {
+        uint sp = STACK_TOP - hart * HART_STACK - STACK_ARGS;
+        for (uint i = 0; i < STACK_ARGS; i += 4) {
+            mem.Write(sp + i, 4, 0);
+        }
+        return sp;
+    }
+
+    void Flush() {
+        if (out_len) {
+            fwrite(out, 1, out_len, stdout);
+            fflush(stdout);
+            out_len = 0;
+        }
+    }
+
+    //return 0 once the guest exits, its status is left in a0
+    bool Handle(uint *reg, MemPort &port) {
+        uint a0 = reg[10], a1 = reg[11], a2 = reg[12];
+        switch (reg[17]) {
+        case SYS_WRITE:
+            reg[10] = Write(port, a0, a1, a2);
+            break;
+        case SYS_READ:
+            reg[10] = Read(port, a0, a1, a2);
+            break;
+        case SYS_FSTAT:
+            reg[10] = Fstat(port, a0, a1);
+            break;
+        case SYS_CLOCK_GETTIME:
+            reg[10] = ClockGettime(port, a0, a1);
+            break;
+        case SYS_BRK:
+            reg[10] = Brk(port, a0);
+            break;
+        case SYS_CLOSE:
+            reg[10] = (a0 <= 2? 0 : -EBADF);
+            break;
+        case SYS_EXIT:
+        case SYS_EXIT_GROUP:
+            Flush();
+            return 0;
+        default:
+//std::cerr << "unknown syscall " << reg[17] << std::endl;
+            reg[10] = -ENOSYS;
+            break;
+        }
+        return 1;
+    }
+};
+
+#endif
@@ -7,15 +7,39 @@
 #include "buffer.h"
 #include "station.h"
 #include "predictor.h"
+#include "config.h"
+#include "fetch.h"
+#include "coherence.h"
+#include "syscall.h"
+#include "tracer.h"
+#include "checker.h"
+#include "dcache.h"
+#include "vpred.h"
 
 #include <iostream>
+#include <string>
 #include <vector>
 using std::vector;
 
+typedef void (*CommitCallback)(const Retire &r, void *user);
+
+//pipeline occupancy at the end of the last cycle
+struct Occupancy {
+    int insq, rob, lsb, rs;
+};
+
+template <class Config = DefaultConfig>
 class Tomasulo_Simulator {
+public:
+    typedef PipeTracer<Config::INSQ_SIZE, Config::ROB_SIZE> Tracer;
+
 private:
+    typedef FetchUnit<Config::FETCH_WORDS> Fetch;
+
     uint reg[32], PC;
-    Memory mem;
+    MemPort port;
+    ProxyKernel kernel;
+    bool own_mem;
 
     struct RegInfo {
         bool busy;
@@ -27,22 +51,41 @@ private:
         }
     };
 
-    struct All {
+    //copied whole every cycle, keep pre and cur on their own cache lines
+    struct alignas(64) All {
         RegInfo regfile[32];
-        Queue<Instruction> insq;
-        ReorderBuffer robuffer;
-        LoadStoreBuffer lsbuffer;
-        ReservationStation rstation;
-        vector< Pair<int, uint> > cdb;
+        Queue<Instruction, Config::INSQ_SIZE> insq;
+        ReorderBuffer<Config::ROB_SIZE> robuffer;
+        LoadStoreBuffer<Config::LSB_SIZE> lsbuffer;
+        ReservationStation<Config::RS_SIZE> rstation;
+        FixedVector<Pair<int, uint>, CDB_WIDTH> cdb;
     } pre, cur;
 
-    vector<ROInfo> newro, can_commit;
-    vector<LSInfo> newls;
-    vector<RSInfo> newrs, can_exe;
-    vector< Pair<int, int> > rf_lock, rf_unlock;
+    FixedVector<ROInfo, ISSUE_WIDTH> newro;
+    FixedVector<ROInfo, COMMIT_WIDTH> can_commit;
+    FixedVector<LSInfo, ISSUE_WIDTH> newls;
+    FixedVector<RSInfo, ISSUE_WIDTH> newrs, can_exe;
+    FixedVector<Pair<int, int>, ISSUE_WIDTH> rf_lock;
+    FixedVector<Pair<int, int>, COMMIT_WIDTH> rf_unlock;
 
-    BranchPredictor predictor;
-    int clk, branch_cnt, success_cnt;
+    typename Config::Predictor predictor;
+    Fetch fetcher;
+    LL clk;
+    int branch_cnt, success_cnt;
+
+    bool done;
+    LL retired_cnt;
+    uint last_pc;
+    CommitCallback commit_cb;
+    void *commit_user;
+    Tracer *tracer;
+    CoSimChecker *checker;
+    DataCache *dcache;
+    ValuePredictor *vpred;
+
+    inline void Trace(int kind, uint pc, int tag) {
+        if (tracer != nullptr) tracer -> Log(kind, clk, pc, tag);
+    }
 
     void Update() {
         pre = cur;
@@ -59,7 +102,13 @@ private:
             cur.robuffer.push(x);
         }
         for (auto x : pre.cdb) {
+            //results of entries a misprediction just squashed are dropped
+            if (!Live(x.first)) continue;
             cur.robuffer.update(x.first, x.second);
+            //the real value of a predicted load disagrees, younger instructions may have used the prediction
+            if (cur.robuffer.vp[x.first] && cur.robuffer.vp_val[x.first] != x.second) {
+                SquashAfter(x.first);
+            }
         }
         if (!cur.robuffer.empty()) {
             ROInfo u = cur.robuffer.front();
@@ -75,49 +124,61 @@ private:
         for (auto x : newls) {
             cur.lsbuffer.push(x);
         }
+        if (dcache != nullptr) {
+            dcache -> Tick(clk);
+        }
         if (!cur.lsbuffer.empty()) {
             LSInfo u = cur.lsbuffer.front();
             if (u.qj == -1 && u.qk == -1) {
-                if (u.func == LOAD) {
-                    uint loadval;
+                if (u.func == LOAD && dcache != nullptr && !dcache -> Load(cur.robuffer.pc[u.rd], u.vj + u.A, u.rd, clk)) {
+                    //its line is still on the way, the load keeps the head
+                } else if (u.func == LOAD) {
+                    uint loadval = 0;
                     switch (u.op) {
                     case LB:
-                        loadval = SignExtend(mem.Read(u.vj + u.A, 1), 8);
+                        loadval = SignExtend(port.Read(u.vj + u.A, 1), 8);
                         break;
                     case LH:
-                        loadval = SignExtend(mem.Read(u.vj + u.A, 2), 16);
+                        loadval = SignExtend(port.Read(u.vj + u.A, 2), 16);
                         break;
                     case LW:
-                        loadval = SignExtend(mem.Read(u.vj + u.A, 4), 32);
+                        loadval = SignExtend(port.Read(u.vj + u.A, 4), 32);
                         break;
                     case LBU:
-                        loadval = mem.Read(u.vj + u.A, 1);
+                        loadval = port.Read(u.vj + u.A, 1);
                         break;
                     case LHU:
-                        loadval = mem.Read(u.vj + u.A, 2);
+                        loadval = port.Read(u.vj + u.A, 2);
                         break;
                     default:
                         break;
                     }
                     cur.lsbuffer.pop();
                     cur.cdb.push_back(Pair<int, uint>(u.rd, loadval));
+                    Trace(EV_DISPATCH, cur.robuffer.pc[u.rd], u.rd);
+                    Trace(EV_CDB, cur.robuffer.pc[u.rd], u.rd);
                 } else if (u.ready) {
                     switch (u.op) {
                     case SB:
-                        mem.Write(u.vj + u.A, 1, u.vk);
+                        port.Write(u.vj + u.A, 1, u.vk);
                         break;
                     case SH:
-                        mem.Write(u.vj + u.A, 2, u.vk);
+                        port.Write(u.vj + u.A, 2, u.vk);
                         break;
                     case SW:
-                        mem.Write(u.vj + u.A, 4, u.vk);
+                        port.Write(u.vj + u.A, 4, u.vk);
                         break;
                     default:
                         break;
                     }
+                    fetcher.Invalidate(port, u.vj + u.A, 4);
+                    if (dcache != nullptr) {
+                        dcache -> Store(u.vj + u.A, clk);
+                    }
                     cur.lsbuffer.pop();
                 } else {
                     cur.robuffer.update(u.rd, 0);
+                    Trace(EV_CDB, cur.robuffer.pc[u.rd], u.rd);
                 }
             }
         }
@@ -130,13 +191,12 @@ private:
         for (auto x : newrs) {
             cur.rstation.push(x);
         }
-        int p = cur.rstation.front();
+        int p = cur.rstation.pick();
         if (p != -1) {
             RSInfo u = cur.rstation.a[p];
-            if (u.qj == -1 && u.qk == -1) {
-                can_exe.push_back(u);
-                cur.rstation.a[p].busy = 0;
-            }
+            can_exe.push_back(u);
+            cur.rstation.a[p].busy = 0;
+            Trace(EV_DISPATCH, cur.robuffer.pc[u.rd], u.rd);
         }
         for (auto x : pre.cdb) {
             cur.rstation.update(x.first, x.second);
@@ -144,14 +204,13 @@ private:
     }
 
     void RunRegfile() {
-        static RegInfo* tmp;
         for (auto x : rf_lock) {
-            tmp = &cur.regfile[x.first];
+            RegInfo *tmp = &cur.regfile[x.first];
             tmp -> qi = x.second;
             tmp -> busy = 1;
         }
         for (auto x : rf_unlock) {
-            tmp = &cur.regfile[x.first];
+            RegInfo *tmp = &cur.regfile[x.first];
             if (tmp -> qi == x.second) {
                 tmp -> qi = -1;
                 tmp -> busy = 0;
@@ -161,22 +220,29 @@ private:
 
     void RunFetch() {
         if (cur.insq.full()) return;
-        Instruction ins = Decode(mem.Read(PC, 4));
+        const Instruction *blk = fetcher.Block(PC);
+        for (int i = Fetch::Offset(PC); i < Config::FETCH_WORDS && !cur.insq.full(); ++i) {
+            Instruction ins = blk[i];
 //std::cerr << std::hex << "fetch " << PC << ' ' << ins.TYPE << std::endl;
-        if (ins.TYPE == WOW) return;
-        ins.pc = PC;
-        if (ins.FTYPE == BRANCH) {
-            ++branch_cnt;
-            if (predictor.predict(PC)) {
+            if (ins.TYPE == WOW) return;
+            ins.pc = PC;
+            if (ins.FTYPE == BRANCH) {
+                ++branch_cnt;
+                if (predictor.predict(PC)) {
+                    PC += ins.imm;
+                } else {
+                    PC += 4;
+                }
+            } else if (ins.TYPE == JAL) {
                 PC += ins.imm;
             } else {
                 PC += 4;
             }
             ins.pred_pc = PC;
-        } else {
-            PC += 4;
+            cur.insq.push(ins);
+            Trace(EV_FETCH, ins.pc, -1);
+            if (PC != ins.pc + 4) return;
         }
-        cur.insq.push(ins);
     }
 
     void RunExecute() {
@@ -193,7 +259,7 @@ private:
 
             //branch
             case JAL:
-                val = ins.A;
+                val = ins.vj + 4;
                 break;
             case JALR:
                 val = ((ins.vj + ins.A) & (-1));
@@ -236,14 +302,15 @@ private:
             case ANDI:
                 val = ins.vj & ins.A;
                 break;
+            //only the low five bits of a shift amount count
             case SLLI:
-                val = ins.vj << ins.A;
+                val = ins.vj << (ins.A & 31);
                 break;
             case SRLI:
-                val = ins.vj >> ins.A;
+                val = ins.vj >> (ins.A & 31);
                 break;
             case SRAI:
-                val = SignExtend(ins.vj >> ins.A, 32 - ins.A);
+                val = (int)ins.vj >> (ins.A & 31);
                 break;
             //calculation
             case ADD:
@@ -253,7 +320,7 @@ private:
                 val = ins.vj - ins.vk;
                 break;
             case SLL:
-                val = ins.vj << ins.vk;
+                val = ins.vj << (ins.vk & 31);
                 break;
             case SLT:
                 val = ((int)(ins.vj) < (int)(ins.vk));
@@ -265,10 +332,10 @@ private:
                 val = ins.vj ^ ins.vk;
                 break;
             case SRL:
-                val = ins.vj >> ins.vk;
+                val = ins.vj >> (ins.vk & 31);
                 break;
             case SRA:
-                val = SignExtend(ins.vj >> ins.vk, 32 - ins.vk);
+                val = (int)ins.vj >> (ins.vk & 31);
                 break;
             case OR:
                 val = ins.vj | ins.vk;
@@ -276,21 +343,27 @@ private:
             case AND:
                 val = ins.vj & ins.vk;
                 break;
+            //loads, stores and system instructions never reach the stations
+            default:
+                val = 0;
+                break;
             }
             pre.cdb.push_back(Pair<int, uint>(ins.rd, val));
+            Trace(EV_CDB, pre.robuffer.pc[ins.rd], ins.rd);
         }
         can_exe.clear();
     }
 
     inline Pair<int, uint> Get_rs(uint pos) {
-        static RegInfo* tmp1;
-        static ROInfo* tmp2;
-        tmp1 = &pre.regfile[pos];
+        const RegInfo *tmp1 = &pre.regfile[pos];
         if (tmp1 -> busy) {
             int where = tmp1 -> qi;
-            tmp2 = &pre.robuffer.que[where];
-            if (tmp2 -> ready) {
-                return Pair<int, uint>(1, tmp2 -> val);
+            if (pre.robuffer.ready[where]) {
+                return Pair<int, uint>(1, pre.robuffer.val[where]);
+            } else if (pre.robuffer.vp[where]) {
+                //speculative wakeup, checked when the producer's value is broadcast
+                ++vpred -> wakeup_cnt;
+                return Pair<int, uint>(1, pre.robuffer.vp_val[where]);
             } else {
                 return Pair<int, uint>(0, where);
             }
@@ -304,9 +377,9 @@ private:
             return;
         }
         Instruction ins = cur.insq.front();
-        int pos = cur.robuffer.apply(), lsb_pos;
+        int pos = cur.robuffer.apply(), lsb_pos = -1;
 
-        static Pair<int, uint> tmp;
+        Pair<int, uint> tmp;
 
         if (ins.FTYPE == LOAD || ins.FTYPE == STORE) {
             if (cur.lsbuffer.full()) {
@@ -326,6 +399,8 @@ private:
                 tmp.first? (u.vk = tmp.second) : (u.qk = tmp.second);
             }
             newls.push_back(u);
+        } else if (ins.TYPE == ECALL) {
+            cur.insq.pop();
         } else if (ins.TYPE != HALT) {
             cur.insq.pop();
             RSInfo u;
@@ -346,19 +421,77 @@ private:
             newrs.push_back(u);
         }
 
-        ROInfo u(ins.TYPE, ins.FTYPE, ins.rd, ins.pc, (ins.TYPE == HALT), lsb_pos, pos);
+        ROInfo u(ins.TYPE, ins.FTYPE, ins.rd, ins.pc, (ins.TYPE == HALT || ins.TYPE == ECALL), lsb_pos, pos);
         if (ins.FTYPE == BRANCH) {
             u.pred_pc = ins.pred_pc;
         }
+        if (ins.FTYPE == LOAD && vpred != nullptr) {
+            u.vp = vpred -> Predict(ins.pc, u.vp_val);
+        }
         newro.push_back(u);
+        Trace(EV_ISSUE, ins.pc, pos);
 
-        if (ins.FTYPE != BRANCH && ins.FTYPE != STORE && ins.TYPE != HALT) {
+        if (ins.FTYPE != BRANCH && ins.FTYPE != STORE && ins.FTYPE != RET && ins.FTYPE != SYS && ins.rd != 0) {
             rf_lock.push_back(Pair<int, int>(ins.rd, pos));
         }
     }
 
+    //pos is an entry of the reorder buffer
+    bool Live(int pos) const {
+        const int MASK = ReorderBuffer<Config::ROB_SIZE>::MASK;
+        return ((pos - cur.robuffer.head) & MASK) < cur.robuffer.size();
+    }
+
+    //drop everything younger than the rob entry at pos and fetch again after it
+    void SquashAfter(int pos) {
+        const int MASK = ReorderBuffer<Config::ROB_SIZE>::MASK;
+        int head = cur.robuffer.head, keep = ((pos - head) & MASK) + 1;
+        for (int i = (pos + 1) & MASK; i != cur.robuffer.tail; i = (i + 1) & MASK) {
+            if (cur.robuffer.func[i] == LOAD && vpred != nullptr) {
+                vpred -> Drop(cur.robuffer.pc[i]);
+            }
+            Trace(EV_SQUASH, cur.robuffer.pc[i], i);
+        }
+        Trace(EV_SQUASH, 0, -1);
+        cur.robuffer.tail = (pos + 1) & MASK;
+        while (!cur.lsbuffer.empty() && (int)((cur.lsbuffer.rd[(cur.lsbuffer.tail - 1) & cur.lsbuffer.MASK] - head) & MASK) >= keep) {
+            cur.lsbuffer.tail = (cur.lsbuffer.tail - 1) & cur.lsbuffer.MASK;
+        }
+        for (auto &x : cur.rstation.a) {
+            if (x.busy && (int)((x.rd - head) & MASK) >= keep) x.busy = 0;
+        }
+        //rename again from the entries left, the rest of the registers are committed
+        for (int i = 0; i < 32; ++i) {
+            cur.regfile[i].busy = 0;
+            cur.regfile[i].qi = -1;
+        }
+        for (int k = 0; k < keep; ++k) {
+            int i = (head + k) & MASK;
+            function_t f = cur.robuffer.func[i];
+            if (f != BRANCH && f != STORE && f != RET && f != SYS && cur.robuffer.rd[i] != 0) {
+                cur.regfile[cur.robuffer.rd[i]].busy = 1;
+                cur.regfile[cur.robuffer.rd[i]].qi = i;
+            }
+        }
+        if (dcache != nullptr) {
+            dcache -> Squash();
+        }
+        cur.insq.clear();
+        newls.clear();
+        newrs.clear();
+        rf_lock.clear();
+        PC = cur.robuffer.pc[pos] + 4;
+    }
+
     void RollBack() {
 //std::cerr << "rollback" << std::endl;
+        Trace(EV_FLUSH, PC, -1);
+        if (dcache != nullptr) {
+            dcache -> Squash();
+        }
+        if (vpred != nullptr) {
+            vpred -> Squash();
+        }
         for (int i = 0; i < 32; ++i) {
             cur.regfile[i].busy = 0;
             cur.regfile[i].qi = -1;
@@ -376,28 +509,45 @@ private:
         rf_unlock.clear();
     }
 
+    //hand a retirement to the callback and the checker, 0 once the checker saw a divergence
+    bool Retired(const Retire &r) {
+        if (commit_cb != nullptr) {
+            commit_cb(r, commit_user);
+        }
+        return checker == nullptr || checker -> push(r, reg);
+    }
+
     bool RunCommit() {
         for (auto x : can_commit) {
 //std::cerr << "commit " << std::hex << x.pc << ' ' << x.op << ' ' << x.rd << ' ' << x.val << std::endl; 
+            Trace(EV_COMMIT, x.pc, x.rob_pos);
             if (x.op == HALT) {
+                if (checker != nullptr) checker -> push(Retire(x.pc, 0, 0, HALT), reg);
                 return 0;
             }
+            ++retired_cnt;
+            last_pc = x.pc;
+            if (x.op == ECALL) {
+                //older stores already reached memory, younger instructions may have read stale a0
+                bool exited = !kernel.Handle(reg, port);
+                if (!Retired(Retire(x.pc, exited? 0 : 10, exited? 0 : reg[10], x.op)) || exited) {
+                    return 0;
+                }
+                RollBack();
+                PC = x.pc + 4;
+                break;
+            }
             if (x.func == JUMP || x.func == BRANCH) {
                 if (x.func == JUMP) {
                     reg[x.rd] = x.pc + 4;
                     rf_unlock.push_back(Pair<int, int>(x.rd, x.rob_pos));
                 }
-                if (x.op == JAL) {
-                    if (x.val != 4) {
-                        RollBack();
-                        PC = x.pc + x.val;
-                    }
-                } else if (x.op == JALR) {
+                if (x.op == JALR) {
                     if (x.val != x.pc + 4) {
                         RollBack();
                         PC = x.val;
                     }
-                } else {
+                } else if (x.func == BRANCH) {
                     if (x.pc + x.val != x.pred_pc) {
                         RollBack();
                         PC = x.pc + x.val;
@@ -408,22 +558,70 @@ private:
                     }
                 }
             } else if (x.func == STORE) {
-                cur.lsbuffer.que[x.lsb_pos].ready = 1;
+                cur.lsbuffer.ready[x.lsb_pos] = 1;
             } else {
                 reg[x.rd] = x.val;
                 rf_unlock.push_back(Pair<int, int>(x.rd, x.rob_pos));
             }
+            uint rd = (x.func != BRANCH && x.func != STORE)? x.rd : 0;
+            Retire r(x.pc, rd, rd? reg[rd] : 0, x.op);
+            if (x.func == STORE) {
+                r.addr = cur.lsbuffer.vj[x.lsb_pos] + cur.lsbuffer.A[x.lsb_pos];
+                r.data = StoreData(x.op, cur.lsbuffer.vk[x.lsb_pos]);
+            }
+            if (!Retired(r)) {
+                return 0;
+            }
+            //a wrong prediction was already squashed when the value came off the cdb
+            if (x.func == LOAD && vpred != nullptr) {
+                vpred -> Train(x.pc, x.val, x.vp, x.vp_val);
+            }
         }
        can_commit.clear();
        reg[0] = 0;
        return 1;
     }
 
-public:
-    Tomasulo_Simulator() {
+    void Init() {
+        memset(reg, 0, sizeof(reg));
+        reg[10] = port.hart;
+        PC = 0;
         clk = branch_cnt = success_cnt = 0;
+        done = 0;
+        retired_cnt = 0;
+        last_pc = 0;
+        commit_cb = nullptr;
+        commit_user = nullptr;
+        tracer = nullptr;
+        checker = nullptr;
+        dcache = nullptr;
+        vpred = nullptr;
     }
 
+public:
+    Tomasulo_Simulator(): port(new Memory(), nullptr, 0), own_mem(1) {
+        Init();
+    }
+
+    //one core of a multi-core machine, a0 holds its hart id at reset
+    Tomasulo_Simulator(Memory &shared, Directory &_dir, int _hart):
+        port(&shared, &_dir, _hart), own_mem(0) {
+        Init();
+    }
+
+    //library use: a raw little-endian image copied to base, execution starts at base
+    Tomasulo_Simulator(const uchar *image, uint len, uint base = 0):
+        port(new Memory(), nullptr, 0), own_mem(1) {
+        Init();
+        port.mem -> Load(image, len, base);
+        load();
+        PC = base;
+    }
+
+    //owns its memory and attached models
+    Tomasulo_Simulator(const Tomasulo_Simulator &) = delete;
+    Tomasulo_Simulator & operator = (const Tomasulo_Simulator &) = delete;
+
     ~Tomasulo_Simulator() {
 		/*
         std::cerr << "total clk : " << clk << std::endl;
@@ -433,40 +631,165 @@ public:
             std::cerr << "total branch: " << branch_cnt << std::endl;
             std::cerr << "successful prediction: " << success_cnt << std::endl;
             std::cerr << "success rate: " << 1.0 * success_cnt / branch_cnt << std::endl;
-        }*/
+        }
+        std::cerr << "fetch block fills: " << fetcher.fill_cnt << std::endl;
+        std::cerr << "next-line prefetch hits: " << fetcher.prefetch_hit << std::endl;*/
+        delete tracer;
+        delete checker;
+        delete dcache;
+        delete vpred;
+        if (own_mem) {
+            delete port.mem;
+        }
     }
 
     void input() {
-        char s[100];
-        int ptr;
-        while (scanf("%s", s) != EOF) {
-            if (s[0] == '@') {
-                ptr = Translate(s + 1);
-            } else {
-                mem[ptr++] = Translate(s);
-            }
-        }
+        port.mem -> Input();
+        load();
     }
 
-    void run() {
-        PC = 0;
-        while (871) {
-            ++clk;
+    //decode the image already in memory
+    void load() {
+        fetcher.Load(*port.mem);
+        kernel.Reset(port.mem -> top);
+        reg[2] = kernel.Stack(*port.mem, port.hart);
+    }
+
+    //simulate one clock, return 0 once HALT commits
+    bool step() {
+        if (done) return 0;
+        ++clk;
 //std::cerr << "clk  " << clk << std::endl;
-            RunROBuffer();
-            RunLSBuffer();
-            RunReservation();
-            RunRegfile();
-            RunFetch();
-            Update();
-            RunExecute();
-            RunIssue();
-            if (!RunCommit()) {
-                break;
+        RunROBuffer();
+        RunLSBuffer();
+        RunReservation();
+        RunRegfile();
+        RunFetch();
+        Update();
+        RunExecute();
+        RunIssue();
+        if (!RunCommit()) {
+            if (checker != nullptr) checker -> flush();
+            kernel.Flush();
+            done = 1;
+            return 0;
+        }
+        return 1;
+    }
+
+    //simulate up to n clocks, return how many were run
+    LL run_cycles(LL n) {
+        LL i = 0;
+        for (; i < n && !done; ++i) {
+            step();
+        }
+        return i;
+    }
+
+    //run until the instruction at pc commits, return 0 if the program halts first
+    bool run_until(uint pc) {
+        while (!done) {
+            LL before = retired_cnt;
+            step();
+            if (retired_cnt != before && last_pc == pc) {
+                return 1;
             }
         }
-        printf("%u\n", reg[10] & 255u);
+        return 0;
+    }
+
+    //log pipeline events to path in Konata format, return 0 if it cannot be opened
+    bool trace(const std::string &path) {
+        FILE *f = fopen(path.c_str(), "w");
+        if (f == nullptr) return 0;
+        delete tracer;
+        tracer = new Tracer(f);
+        return 1;
+    }
+
+    const Tracer * pipe_tracer() const {
+        return tracer;
+    }
+
+    //co-simulate against the in-order interpreter from the loaded image, call after input() or load()
+    void check() {
+        delete checker;
+        checker = new CoSimChecker(*port.mem, PC);
+    }
+
+    //give loads the latency of an L1 data cache fed by the given prefetcher
+    void prefetch(prefetch_t mode) {
+        delete dcache;
+        dcache = new DataCache(mode);
+    }
+
+    const DataCache * data_cache() const {
+        return dcache;
+    }
+
+    //let dependents of loads issue on predicted values
+    void predict_values(vpred_t mode) {
+        delete vpred;
+        vpred = (mode == VP_NONE? nullptr : new ValuePredictor(mode));
+    }
+
+    const ValuePredictor * value_predictor() const {
+        return vpred;
+    }
+
+    bool diverged() const {
+        return checker != nullptr && checker -> diverged();
+    }
+
+    void on_commit(CommitCallback cb, void *user) {
+        commit_cb = cb;
+        commit_user = user;
+    }
+
+    const uint * regs() const {
+        return reg;
+    }
+
+    const Memory & memory() const {
+        return *port.mem;
+    }
+
+    Occupancy occupancy() const {
+        Occupancy ret;
+        ret.insq = cur.insq.size();
+        ret.rob = cur.robuffer.size();
+        ret.lsb = cur.lsbuffer.size();
+        ret.rs = cur.rstation.size();
+        return ret;
+    }
+
+    LL cycles() const {
+        return clk;
+    }
+
+    LL retired() const {
+        return retired_cnt;
+    }
+
+    bool halted() const {
+        return done;
+    }
+
+    uint result() const {
+        return reg[10] & 255u;
+    }
+
+    void run() {
+        while (step());
+        printf("%u\n", result());
     }
 };
 
+//each configuration is compiled once, in its own config_*.cpp; declared here so that
+//no file including this header instantiates the simulator itself
+extern template class Tomasulo_Simulator<DefaultConfig>;
+extern template class Tomasulo_Simulator<SmallConfig>;
+extern template class Tomasulo_Simulator<WideConfig>;
+extern template class Tomasulo_Simulator<StaticConfig>;
+
 #endif
\ No newline at end of file
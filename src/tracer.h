@@ -0,0 +1,307 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include "tools.h"
+#include "buffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+const int TRACE_RING = 1 << 16;
+const int TRACE_BUF = 1 << 16;
+const int TRACE_BATCH = 256;    //events the core hands over at a time
+static_assert(TRACE_BATCH < TRACE_RING, "a batch must fit the ring");
+
+enum event_t {
+    EV_FETCH, EV_ISSUE, EV_DISPATCH, EV_CDB, EV_COMMIT, EV_FLUSH, EV_SQUASH
+};
+
+struct TraceEvent {
+    LL clk;
+    uint pc;
+    int tag;    //rob position, -1 before issue
+    int kind;
+};
+
+//single-producer single-consumer ring, each side caches the other's index
+template <typename T, int SIZ>
+class SpscRing {
+public:
+    static_assert((SIZ & (SIZ - 1)) == 0, "ring size must be a power of two");
+    static const int MASK = SIZ - 1;
+
+private:
+    alignas(64) std::atomic<int> head;
+    int tail_cache;
+    alignas(64) std::atomic<int> tail;
+    int head_cache;
+    alignas(64) T buf[SIZ];
+
+public:
+    SpscRing(): head(0), tail_cache(0), tail(0), head_cache(0) {}
+
+    //all n items or none
+    bool push(const T *x, int n) {
+        int t = tail.load(std::memory_order_relaxed);
+        if (((head_cache - t - 1) & MASK) < n) {
+            head_cache = head.load(std::memory_order_acquire);
+            if (((head_cache - t - 1) & MASK) < n) return 0;
+        }
+        for (int i = 0; i < n; ++i) {
+            buf[(t + i) & MASK] = x[i];
+        }
+        tail.store((t + n) & MASK, std::memory_order_release);
+        return 1;
+    }
+
+    //up to n items, return how many were taken
+    int pop(T *x, int n) {
+        int h = head.load(std::memory_order_relaxed);
+        if (h == tail_cache) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (h == tail_cache) return 0;
+        }
+        int k = (tail_cache - h) & MASK;
+        if (k > n) k = n;
+        for (int i = 0; i < k; ++i) {
+            x[i] = buf[(h + i) & MASK];
+        }
+        head.store((h + k) & MASK, std::memory_order_release);
+        return k;
+    }
+};
+
+//pipeline events of one core, written by a background thread as a Konata (Kanata 0004) log;
+//INSQ and ROB are the core's queue sizes
+template <int INSQ, int ROB>
+class PipeTracer {
+
+private:
+    //one fetched instruction waiting in the instruction queue
+    struct Fetched {
+        LL id;
+        uint pc;
+    };
+
+    //stage reached by the instruction holding a rob entry
+    enum {
+        ST_ISSUE = 1, ST_EXEC, ST_DONE
+    };
+
+    SpscRing<TraceEvent, TRACE_RING> ring;
+    std::atomic<bool> stop;
+    std::thread writer;
+    FILE *out;
+
+    //core side only, published to the ring a batch at a time
+    TraceEvent batch[TRACE_BATCH];
+    int batch_len;
+
+    //writer side only
+    char text[TRACE_BUF + 64];
+    int len;
+    LL now, next_id, retire_id;
+    Queue<Fetched, INSQ> fetched;
+    LL rob_id[ROB];
+    int rob_stage[ROB];
+
+    //printf is too slow to keep up with the core, lines are formatted by hand
+    void Put(const char *s) {
+        while (*s) text[len++] = *s++;
+    }
+
+    void Put(LL x) {
+        char d[20];
+        int n = 0;
+        do {
+            d[n++] = '0' + x % 10;
+            x /= 10;
+        } while (x);
+        while (n) text[len++] = d[--n];
+    }
+
+    void PutHex(uint x) {
+        for (int i = 28; i >= 0; i -= 4) {
+            text[len++] = "0123456789abcdef"[(x >> i) & 15];
+        }
+    }
+
+    //a line is at most 64 bytes
+    void EndLine() {
+        text[len++] = '\n';
+        if (len >= TRACE_BUF) {
+            fwrite(text, 1, len, out);
+            len = 0;
+        }
+    }
+
+    void Line(const char *cmd, LL id, LL x, const char *rest) {
+        Put(cmd);
+        Put(id);
+        Put("\t");
+        Put(x);
+        Put(rest);
+        EndLine();
+    }
+
+    void Insert(LL id, uint pc) {
+        Line("I\t", id, id, "\t0");
+        Put("L\t");
+        Put(id);
+        Put("\t0\t");
+        PutHex(pc);
+        EndLine();
+    }
+
+    void Squash(LL id) {
+        Line("R\t", id, 0, "\t1");
+    }
+
+    void Stage(int tag, int stage, const char *name) {
+        if (rob_id[tag] == -1 || rob_stage[tag] >= stage) return;
+        rob_stage[tag] = stage;
+        Line("S\t", rob_id[tag], 0, name);
+    }
+
+    void Write(const TraceEvent &e) {
+        if (e.clk != now) {
+            Put("C\t");
+            Put(e.clk - now);
+            EndLine();
+            now = e.clk;
+        }
+        switch (e.kind) {
+        case EV_FETCH: {
+            Fetched f;
+            f.id = next_id++;
+            f.pc = e.pc;
+            if (fetched.full()) {
+                Squash(fetched.front().id);
+                fetched.pop();
+            }
+            fetched.push(f);
+            Insert(f.id, e.pc);
+            Line("S\t", f.id, 0, "\tF");
+            break;
+        }
+        case EV_ISSUE: {
+            //HALT stays in the queue and issues again every cycle, those copies were never fetched
+            LL id;
+            if (!fetched.empty() && fetched.front().pc == e.pc) {
+                id = fetched.front().id;
+                fetched.pop();
+            } else {
+                id = next_id++;
+                Insert(id, e.pc);
+            }
+            if (rob_id[e.tag] != -1) Squash(rob_id[e.tag]);
+            rob_id[e.tag] = id;
+            rob_stage[e.tag] = 0;
+            Put("L\t");
+            Put(id);
+            Put("\t1\trob ");
+            Put((LL)e.tag);
+            EndLine();
+            Stage(e.tag, ST_ISSUE, "\tIs");
+            break;
+        }
+        case EV_DISPATCH:
+            Stage(e.tag, ST_EXEC, "\tEx");
+            break;
+        case EV_CDB:
+            Stage(e.tag, ST_DONE, "\tWb");
+            break;
+        case EV_COMMIT:
+            if (rob_id[e.tag] == -1) break;
+            Line("R\t", rob_id[e.tag], retire_id++, "\t0");
+            rob_id[e.tag] = -1;
+            break;
+        case EV_SQUASH:
+            //one rob entry behind a mispredicted load, -1 for the instruction queue
+            if (e.tag == -1) {
+                for (; !fetched.empty(); fetched.pop()) {
+                    Squash(fetched.front().id);
+                }
+            } else if (rob_id[e.tag] != -1) {
+                Squash(rob_id[e.tag]);
+                rob_id[e.tag] = -1;
+            }
+            break;
+        case EV_FLUSH:
+            for (; !fetched.empty(); fetched.pop()) {
+                Squash(fetched.front().id);
+            }
+            for (int i = 0; i < ROB; ++i) {
+                if (rob_id[i] != -1) Squash(rob_id[i]);
+                rob_id[i] = -1;
+            }
+            break;
+        }
+    }
+
+    void Drain() {
+        TraceEvent e[TRACE_BATCH];
+        while (871) {
+            bool last = stop.load(std::memory_order_acquire);
+            for (int n; (n = ring.pop(e, TRACE_BATCH)) > 0; ) {
+                for (int i = 0; i < n; ++i) {
+                    Write(e[i]);
+                }
+            }
+            if (last) break;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        fwrite(text, 1, len, out);
+        fflush(out);
+    }
+
+    //the core only waits when the writer has fallen a whole ring behind
+    void Publish() {
+        if (!ring.push(batch, batch_len)) {
+            ++stall_cnt;
+            while (!ring.push(batch, batch_len)) {
+                std::this_thread::yield();
+            }
+        }
+        event_cnt += batch_len;
+        batch_len = 0;
+    }
+
+public:
+    LL event_cnt, stall_cnt;    //events handed to the writer, batches that waited for it
+
+    //out is owned and closed by the tracer
+    PipeTracer(FILE *_out): stop(0), out(_out), batch_len(0), len(0), now(0), next_id(0), retire_id(0),
+        event_cnt(0), stall_cnt(0) {
+        for (int i = 0; i < ROB; ++i) {
+            rob_id[i] = -1;
+        }
+        fprintf(out, "Kanata\t0004\nC=\t0\n");
+        writer = std::thread(&PipeTracer::Drain, this);
+    }
+
+    ~PipeTracer() {
+        Publish();
+        stop.store(1, std::memory_order_release);
+        writer.join();
+        fclose(out);
+    }
+
+    inline void Log(int kind, LL clk, uint pc, int tag) {
+        TraceEvent &e = batch[batch_len];
+        e.clk = clk;
+        e.pc = pc;
+        e.tag = tag;
+        e.kind = kind;
+        if (++batch_len == TRACE_BATCH) Publish();
+    }
+
+    void Report(std::ostream &os) const {
+        os << "trace events: " << event_cnt + batch_len << " batches that waited for the writer: " << stall_cnt << std::endl;
+    }
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef VPRED_H
+#define VPRED_H
+
+#include "tools.h"
+
+#include <iostream>
+
+const int VP_ENTRIES = 1024;    //pc-indexed, direct mapped
+const int VP_CONFIDENT = 3;     //correct predictions in a row before one is used
+
+enum vpred_t {
+    VP_NONE, VP_LAST, VP_STRIDE
+};
+
+//load value predictor, trained in order at commit
+class ValuePredictor {
+
+private:
+    struct Entry {
+        uint pc, last;
+        int stride;
+        uchar conf;
+        int inflight;   //issued instances not committed yet
+        bool valid;
+        Entry() {
+            valid = 0;
+            inflight = 0;
+        }
+    } a[VP_ENTRIES];
+    vpred_t mode;
+
+    Entry & Get(uint pc) {
+        return a[(pc >> 2) & (VP_ENTRIES - 1)];
+    }
+
+public:
+    LL load_cnt, predict_cnt, correct_cnt, wakeup_cnt;
+
+    ValuePredictor(vpred_t _mode): mode(_mode) {
+        load_cnt = predict_cnt = correct_cnt = wakeup_cnt = 0;
+    }
+
+    //at issue: 1 with the value when the entry is confident, every instance in flight moves a stride further
+    bool Predict(uint pc, uint &val) {
+        Entry &e = Get(pc);
+        if (!e.valid || e.pc != pc) return 0;
+        ++e.inflight;
+        if (e.conf < VP_CONFIDENT) return 0;
+        val = e.last + (mode == VP_STRIDE? e.stride * e.inflight : 0);
+        return 1;
+    }
+
+    //at commit of a load, predicted tells whether it carried a prediction
+    void Train(uint pc, uint val, bool predicted, uint pred_val) {
+        Entry &e = Get(pc);
+        ++load_cnt;
+        if (predicted) {
+            ++predict_cnt;
+            correct_cnt += (val == pred_val);
+        }
+        if (!e.valid || e.pc != pc) {
+            e.valid = 1;
+            e.pc = pc;
+            e.last = val;
+            e.stride = 0;
+            e.conf = 0;
+            e.inflight = 0;
+            return;
+        }
+        if (e.inflight > 0) --e.inflight;
+        int stride = val - e.last;
+        bool hit = (mode == VP_STRIDE? stride == e.stride : stride == 0);
+        if (predicted && val != pred_val) {
+            hit = 0;
+        }
+        if (hit) {
+            if (e.conf < 7) ++e.conf;
+        } else {
+            e.conf = 0;
+            if (mode == VP_STRIDE) e.stride = stride;
+        }
+        e.last = val;
+    }
+
+    //an instance issued at pc was squashed before it committed
+    void Drop(uint pc) {
+        Entry &e = Get(pc);
+        if (e.valid && e.pc == pc && e.inflight > 0) --e.inflight;
+    }
+
+    //a rollback dropped everything in flight
+    void Squash() {
+        for (int i = 0; i < VP_ENTRIES; ++i) {
+            a[i].inflight = 0;
+        }
+    }
+
+    //coverage: committed loads that carried a prediction, accuracy: predictions that were right
+    void Report(std::ostream &os) const {
+        os << "value prediction loads: " << load_cnt << " predicted: " << predict_cnt
+           << " correct: " << correct_cnt << " speculative wakeups: " << wakeup_cnt << std::endl;
+        os << "coverage: " << (load_cnt? 1.0 * predict_cnt / load_cnt : 0)
+           << " accuracy: " << (predict_cnt? 1.0 * correct_cnt / predict_cnt : 0) << std::endl;
+    }
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "tools.h"
+#include "tomasulo.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+using std::vector;
+
+//the steady-state cycle loop must not touch the heap
+
+static LL alloc_cnt = 0;
+
+void * operator new(size_t n) {
+    ++alloc_cnt;
+    void *p = malloc(n? n : 1);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+uint R(uint f7, uint rs2, uint rs1, uint f3, uint rd, uint op) {
+    return f7 << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | rd << 7 | op;
+}
+
+uint I(int imm, uint rs1, uint f3, uint rd, uint op) {
+    return (uint)(imm & 0xFFF) << 20 | rs1 << 15 | f3 << 12 | rd << 7 | op;
+}
+
+uint S(int imm, uint rs2, uint rs1, uint f3) {
+    return (uint)(imm >> 5 & 0x7F) << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | (imm & 0x1F) << 7 | 0x23;
+}
+
+uint B(int imm, uint rs2, uint rs1, uint f3) {
+    return (uint)(imm >> 12 & 1) << 31 | (uint)(imm >> 5 & 0x3F) << 25 | rs2 << 20 | rs1 << 15
+         | f3 << 12 | (imm >> 1 & 0xF) << 8 | (imm >> 11 & 1) << 7 | 0x63;
+}
+
+//an endless loop of stores, dependent loads and a branch taken three times in four
+vector<uint> Program() {
+    vector<uint> p;
+    p.push_back(I(0, 0, 0, 1, 0x13));           //addi x1, x0, 0
+    p.push_back(0x00010137);                    //lui  x2, 0x10
+    p.push_back(I(0, 0, 0, 3, 0x13));           //addi x3, x0, 0
+    p.push_back(S(0, 1, 2, 2));                 //loop: sw x1, 0(x2)
+    p.push_back(I(0, 2, 2, 4, 0x03));           //lw   x4, 0(x2)
+    p.push_back(R(0, 4, 3, 0, 3, 0x33));        //add  x3, x3, x4
+    p.push_back(I(1, 1, 0, 1, 0x13));           //addi x1, x1, 1
+    p.push_back(I(3, 1, 7, 5, 0x13));           //andi x5, x1, 3
+    p.push_back(I(4, 2, 0, 2, 0x13));           //addi x2, x2, 4
+    p.push_back(B(-24, 0, 5, 1));               //bne  x5, x0, loop
+    p.push_back(I(-16, 2, 0, 2, 0x13));         //addi x2, x2, -16
+    p.push_back(B(-32, 0, 0, 0));               //beq  x0, x0, loop
+    return p;
+}
+
+bool Check(const char *name, Tomasulo_Simulator<> &s) {
+    s.run_cycles(10000);
+    alloc_cnt = 0;
+    LL n = s.run_cycles(100000);
+    if (n != 100000 || alloc_cnt) {
+        fprintf(stderr, "%s: %lld heap allocations in %lld cycles\n", name, alloc_cnt, n);
+        return 0;
+    }
+    return 1;
+}
+
+int main() {
+    vector<uint> p = Program();
+    const uchar *image = (const uchar *)p.data();
+    uint len = p.size() * 4;
+
+    Tomasulo_Simulator<> *core = new Tomasulo_Simulator<>(image, len);
+    Tomasulo_Simulator<> *models = new Tomasulo_Simulator<>(image, len);
+    models -> prefetch(PF_STRIDE);
+    models -> predict_values(VP_STRIDE);
+    bool ok = Check("core", *core) && Check("core with models", *models);
+    delete models;
+    delete core;
+    if (!ok) return 1;
+    printf("no heap allocations in the cycle loop\n");
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "tools.h"
+#include "dcache.h"
+
+#include <cstdio>
+
+//an array written once and then read in order must miss without a prefetcher,
+//and a stride prefetcher must turn most of those misses into useful prefetches
+
+const uint BASE = 0x10000;
+const int WORDS = 4096;     //16KB, the size of the cache
+
+//store every word, then load them back; return the cycle the walk ends
+LL Walk(DataCache &c) {
+    LL clk = 0;
+    for (int i = 0; i < WORDS; ++i) {
+        c.Tick(++clk);
+        c.Store(BASE + i * 4, clk);
+    }
+    for (int i = 0; i < WORDS; ++i) {
+        c.Tick(++clk);
+        while (!c.Load(0x40, BASE + i * 4, 0, clk)) {
+            c.Tick(++clk);
+        }
+    }
+    return clk;
+}
+
+int main() {
+    DataCache *plain = new DataCache(PF_NONE), *stride = new DataCache(PF_STRIDE);
+    LL t0 = Walk(*plain), t1 = Walk(*stride);
+    bool ok = 1;
+    if (plain -> miss_cnt != WORDS * 4 >> LINE_BITS) {
+        fprintf(stderr, "no prefetcher: %lld misses, expected one per line\n", plain -> miss_cnt);
+        ok = 0;
+    }
+    if (stride -> pf_useful * 2 < plain -> miss_cnt || t1 >= t0) {
+        fprintf(stderr, "stride prefetcher: %lld useful prefetches, %lld cycles against %lld\n",
+                stride -> pf_useful, t1, t0);
+        ok = 0;
+    }
+    if (ok) {
+        printf("initialized array: %lld misses, %lld of them prefetched\n", plain -> miss_cnt, stride -> pf_useful);
+    }
+    delete stride;
+    delete plain;
+    return ok? 0 : 1;
+}
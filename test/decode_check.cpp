@@ -0,0 +1,97 @@
+#include "tools.h"
+#include "instructions.h"
+#include "memory.h"
+#include "decoder.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <vector>
+using std::vector;
+
+//the batch decoder must agree bit for bit with Decode on every word it caches
+
+//deterministic words: every opcode, func3 and bit-30 combination with a few
+//register and immediate patterns, the special encodings, then random words
+vector<uint> Words() {
+    vector<uint> ret;
+    const uint fill[] = {0, 0xFFFFFFFF, 0x80000000, 0x7FFFF000, 0x00A50F80, 0x81234567};
+    for (uint op = 0; op < 128; ++op) {
+        for (uint func3 = 0; func3 < 8; ++func3) {
+            for (uint alt = 0; alt < 2; ++alt) {
+                for (uint x : fill) {
+                    uint w = (x & ~0x4000707Fu) | op | (func3 << 12) | (alt << 30);
+                    ret.push_back(w);
+                }
+            }
+        }
+    }
+    ret.push_back(0x0ff00513);
+    ret.push_back(0x00000073);
+    ret.push_back(0x00100073);
+    unsigned long long s = 871;
+    while (ret.size() < (size_t)CODE_WORDS * 4) {
+        s = s * 6364136223846793005ull + 1442695040888963407ull;
+        ret.push_back(s >> 32);
+    }
+    return ret;
+}
+
+//every extractor the host runs must produce the scalar fields
+bool CheckExtractors(const vector<uint> &w) {
+    vector<FieldExtractor> fn;
+#if defined(__SSE2__)
+    fn.push_back(ExtractFieldsSse2);
+#endif
+#ifdef DECODE_AVX2
+    if (__builtin_cpu_supports("avx2")) fn.push_back(ExtractFieldsAvx2);
+#endif
+    for (size_t i = 0; i + DECODE_BATCH <= w.size(); i += DECODE_BATCH) {
+        DecodeFields ref, got;
+        memcpy(ref.word, &w[i], sizeof(ref.word));
+        ExtractFieldsScalar(ref);
+        for (size_t k = 0; k < fn.size(); ++k) {
+            memcpy(got.word, &w[i], sizeof(got.word));
+            fn[k](got);
+            if (memcmp(&ref, &got, sizeof(ref))) {
+                fprintf(stderr, "extractor %d differs on the batch at word %zu\n", (int)k, i);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+//fill the image CODE_WORDS words at a time, compare each cached entry with Decode
+bool CheckCache(const vector<uint> &w) {
+    Memory *mem = new Memory();
+    DecodeCache *cache = new DecodeCache();
+    bool ok = 1;
+    for (size_t base = 0; base < w.size() && ok; base += CODE_WORDS) {
+        size_t n = std::min(w.size() - base, (size_t)CODE_WORDS);
+        for (size_t i = 0; i < n; ++i) {
+            mem -> Write(i << 2, 4, w[base + i]);
+        }
+        cache -> Load(*mem);
+        for (size_t i = 0; i < n; ++i) {
+            Instruction a = Decode(w[base + i]), b = cache -> Get(i << 2);
+            if (memcmp(&a, &b, sizeof(Instruction))) {
+                fprintf(stderr, "decode mismatch on %08x: type %d/%d ftype %d/%d rd %u/%u rs1 %u/%u rs2 %u/%u imm %08x/%08x\n",
+                        w[base + i], a.TYPE, b.TYPE, a.FTYPE, b.FTYPE, a.rd, b.rd, a.rs1, b.rs1, a.rs2, b.rs2, a.imm, b.imm);
+                ok = 0;
+                break;
+            }
+        }
+    }
+    delete cache;
+    delete mem;
+    return ok;
+}
+
+int main() {
+    vector<uint> w = Words();
+    if (!CheckExtractors(w) || !CheckCache(w)) {
+        return 1;
+    }
+    printf("%zu words decoded identically\n", w.size());
+    return 0;
+}